@@ -38,22 +38,57 @@ of Elite with no combat or missions.
 #include <time.h>
 #include <math.h>
 #include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#if defined(__has_include)
+#if __has_include(<stdckdint.h>)
+#include <stdckdint.h>
+#endif
+#endif
+
+#ifdef ckd_add  /* C23 checked arithmetic, else the GCC and Clang builtins it came from */
+#define CHECKED_ADD(result, a, b) ckd_add(result, a, b)
+#define CHECKED_MUL(result, a, b) ckd_mul(result, a, b)
+#else
+#define CHECKED_ADD(result, a, b) __builtin_add_overflow(a, b, result)
+#define CHECKED_MUL(result, a, b) __builtin_mul_overflow(a, b, result)
+#endif
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <poll.h>
+#endif
 
 // Forward declarations for structs
 struct SeedType;
 struct PlanSys;
 
 #define MAX_LEN 30
-#define GAL_SIZE (256)
+#define GAL_SIZE (256)  /* Systems in a canonical galaxy */
 #define ALIEN_ITEMS (16)
 #define LAST_TRADE ALIEN_ITEMS
-#define NUM_COMMANDS (14) // Renamed from nocomms
+#define NUM_COMMANDS (22) // Renamed from nocomms
+#define NUM_GALAXIES (8) /* Galaxies in the canonical universe */
+#define MAX_GALAXIES (64)
+#define MAX_GAL_SIZE (1 << 20)
+#define NUM_TECH_LEVELS (16)
+#define NUM_POP_BANDS (16)
+#define MAX_WORKERS (64)
+#define NUM_STRATEGIES (3)
 
 const int TONNES = 0;
 
 int ExitStatus = EXIT_SUCCESS;
 
 typedef int PlanetNum;
+typedef int64_t Money; /* Credits in tenths, as the original kept them */
 
 // Simplified struct definitions
 struct FastSeedType {
@@ -79,7 +114,34 @@ struct PlanSys {
     char name[12]; // Renamed from Name
 };
 
-static_assert(GAL_SIZE == 256, "Galaxy size must be 256");
+#define NAME_WIDTH (8) /* Longest system name: four letter pairs */
+#define FUZZY_MAX_QUERY (64) /* One bit per letter in a machine word */
+
+struct SysCoord {
+    uint8_t x;
+    uint8_t y;
+};
+
+/* economy in bits 0-2, govType 3-5, techLev 6-9, radius/256-11 in 10-13 */
+typedef uint16_t SysAttrs;
+
+/* 
+ * A galaxy stored column by column so scans only touch what they need:
+ * 32 systems' coordinates or attributes fit in one cache line. Full
+ * PlanSys records are rebuilt on demand by get_system. Each column is
+ * GalaxySize long, and the columns of all galaxies lie end to end in one
+ * block (coordinates of every galaxy, then attributes, ...).
+ */
+typedef struct {
+    struct SysCoord *coord;
+    SysAttrs *attrs;
+    struct FastSeedType *goatSoupSeed;
+    char (*name)[NAME_WIDTH]; /* Zero padded; no terminator at full width */
+} GalaxyColumns;
+
+#define UNIVERSE_BYTES_PER_SYSTEM (sizeof(struct SysCoord) + sizeof(SysAttrs) + \
+                                   sizeof(struct FastSeedType) + NAME_WIDTH)
+
 static_assert(ALIEN_ITEMS == 16, "AlienItems must be 16");
 
 #define NUM_FOR_LAVE 7       /* Lave is 7th generated planet in galaxy one */
@@ -87,11 +149,77 @@ static_assert(ALIEN_ITEMS == 16, "AlienItems must be 16");
 #define NUM_FOR_DISO 147
 #define NUM_FOR_RIED 46
 
-struct PlanSys Galaxy[GAL_SIZE]; /* Need 0 to galsize-1 inclusive */
+/*
+ * Canonical universe tables generated at build time by running this program
+ * with --emit-universe (see Makefile). Without them the galaxies are
+ * generated at startup instead.
+ */
+#if !defined(NO_EMBEDDED_UNIVERSE) && defined(__has_include)
+#if __has_include("universe.h")
+#include "universe.h"
+#define HAVE_EMBEDDED_UNIVERSE 1
+#endif
+#endif
+
+/* Shape of the universe; --galaxies and --galaxy-size change it */
+uint16_t GalaxyCount = NUM_GALAXIES;
+PlanetNum GalaxySize = GAL_SIZE;
+
+/* 
+ * GalaxyCount galaxies, viewing the embedded tables, a mapped universe
+ * file or GeneratedUniverse. Mapped columns are read-only.
+ */
+GalaxyColumns *Universe;
+void *GeneratedUniverse;
+
+const GalaxyColumns *Galaxy; /* Current galaxy, 0 to galsize-1 inclusive */
+
+/* One bit per system in the universe; bit (galaxy-1)*GalaxySize+planet */
+typedef struct {
+    uint64_t *bits; /* SetWords words */
+} SystemSet;
+
+uint32_t SetWords;
+
+SystemSet EconomyIndex[8];
+SystemSet GovIndex[8];
+SystemSet TechIndex[NUM_TECH_LEVELS];
+SystemSet PopIndex[NUM_POP_BANDS]; /* Population in whole billions */
+
+/* Systems within MaxFuel of each other, in compressed sparse row form */
+typedef struct {
+    bool built;
+    uint32_t *offset;       /* Neighbours of i are [offset[i], offset[i+1]) */
+    PlanetNum *neighbour;
+    uint8_t *hopDistance;   /* In tenths of a LY, never above MaxFuel */
+    uint32_t *component;    /* Systems reachable from each other share one */
+    uint32_t numComponents;
+} JumpGraph;
+
+JumpGraph *JumpGraphs;
+bool UniverseIndexBuilt;
+
+/* Coordinates are bucketed into GRID_DIM x GRID_DIM cells for range queries */
+#define GRID_SHIFT (4)
+#define GRID_DIM (256 >> GRID_SHIFT)
+
+/* Per-galaxy search structures, built on first use */
+typedef struct {
+    bool built;
+    PlanetNum *byName;                        /* Systems in name order */
+    uint32_t cellStart[GRID_DIM * GRID_DIM + 1];
+    PlanetNum *byCell;                        /* Systems cell by cell, ascending within each */
+} GalaxyLookup;
+
+GalaxyLookup *GalaxyLookups;
 
-struct SeedType Seed;
+#define DESCRIPTION_WIDTH (512)
 
-struct FastSeedType RndSeed;
+/* A goat soup description, built up in place of printing it */
+typedef struct {
+	char text[DESCRIPTION_WIDTH];
+	size_t length;
+} Description;
 
 bool NativeRand;
 
@@ -120,14 +248,19 @@ typedef struct {
     uint16_t price[LAST_TRADE + 1]; // Renamed from Price
 } MarketType;
 
-/* Player workspace */
-uint16_t ShipHold[LAST_TRADE + 1];  /* Contents of cargo bay */
-int CurrentPlanet;                 /* Current planet */
-uint16_t GalaxyNum;                /* Galaxy number (1-8) */
-int32_t Cash;
-uint16_t Fuel;
-MarketType LocalMarket;
-uint16_t HoldSpace;
+/* Commander workspace: the player's, or one of many simulated ones */
+typedef struct {
+	uint16_t shipHold[LAST_TRADE + 1];  /* Contents of cargo bay */
+	PlanetNum currentPlanet;            /* Current planet */
+	uint16_t galaxyNum;                 /* Galaxy number (1-GalaxyCount) */
+	Money cash;
+	uint16_t fuel;
+	MarketType localMarket;
+	uint8_t fluctuation;                /* Rolled for localMarket on arrival */
+	uint16_t holdSpace;
+} Commander;
+
+Commander Player;
 
 int FuelCost = 2; /* 0.2 CR/Light year */
 int MaxFuel = 70; /* 7.0 LY tank */
@@ -136,6 +269,25 @@ const uint16_t BASE_0 = 0x5A4A;
 const uint16_t BASE_1 = 0x0248;
 const uint16_t BASE_2 = 0xB753;  /* Base seed for galaxy 1 */
 
+/* Base seed the universe is generated from (BASE_0..BASE_2); --seed replaces it */
+struct SeedType BaseSeed = {0x5A4A, 0x0248, 0xB753};
+bool CustomSeed = false;
+
+#define UNIVERSE_FILE_MAGIC "TXTELUNI"
+#define UNIVERSE_FILE_VERSION (3)
+
+/* Universe file layout: this header, then the column block (see GalaxyColumns) */
+struct UniverseFileHeader {
+    char magic[8];
+    uint64_t checksum;     /* FNV-1a over the galaxy records */
+    uint32_t version;
+    uint32_t systemBytes;  /* UNIVERSE_BYTES_PER_SYSTEM of the writer */
+    uint16_t seed[3];
+    uint16_t numGalaxies;
+    uint32_t galaxySize;
+    uint32_t reserved;
+};
+
 
 //static const char *digrams=
 //							 "ABOUSEITILETSTONLONUTHNO"
@@ -180,7 +332,7 @@ char UnitNames[][5] ={"t","kg","g"};
 #define POLITICALLY_CORRECT	0
 /* Set to 1 for NES-sanitised trade goods */
 
-TradeGood Commodities[] = {
+TradeGood Commodities[LAST_TRADE + 1] = {
     {0x13, -0x02, 0x06, 0x01, 0, "Food        "},
     {0x14, -0x01, 0x0A, 0x03, 0, "Textiles    "},
     {0x41, -0x03, 0x02, 0x07, 0, "Radioactives"},
@@ -212,11 +364,13 @@ char tradnames[LAST_TRADE][MAX_LEN];
 // Forward function declarations
 void tweak_seed(struct SeedType *seedToTweak);
 struct PlanSys make_system(struct SeedType *initialSeed);
-MarketType generate_market(uint16_t fluctuation, struct PlanSys planetSystem);
+MarketType generate_market(uint16_t fluctuation, uint16_t economy);
 void next_galaxy(struct SeedType *currentSeed);
-uint16_t distance(struct PlanSys systemA, struct PlanSys systemB);
-void print_system_info(struct PlanSys planetSystemInfo, bool useCompressedOutput);
-void goat_soup(const char *sourceString, struct PlanSys *planetSystem);
+uint16_t distance(struct SysCoord systemA, struct SysCoord systemB);
+void print_system_info(const GalaxyColumns *galaxy, PlanetNum planetIndex, bool useCompressedOutput);
+void goat_soup(const char *sourceString, const struct PlanSys *planetSystem, struct FastSeedType *rndSeed, Description *out);
+void system_description(const GalaxyColumns *galaxy, PlanetNum planetIndex, Description *out);
+uint16_t calculate_fuel_purchase(Commander *cmdr, uint16_t fuelAmount);
 
 bool do_buy(char *commandArguments);
 bool do_sell(char *commandArguments);
@@ -232,13 +386,23 @@ bool do_planet_info_display(char *commandArguments);
 bool do_galactic_hyperspace(char *commandArguments);
 bool do_quit(char *commandArguments);
 bool do_tweak_random_native(char *commandArguments);
+bool do_find(char *commandArguments);
+bool do_route(char *commandArguments);
+bool do_sim(char *commandArguments);
+bool do_npc(char *commandArguments);
+bool do_tick(char *commandArguments);
+bool do_arbitrage(char *commandArguments);
+bool do_plan(char *commandArguments);
+bool do_fill(char *commandArguments);
 
 char commands[NUM_COMMANDS][MAX_LEN]=
 {
 	"buy",        "sell",     "fuel",     "jump",
 	"cash",       "mkt",      "help",     "hold",
 	"sneak",      "local",    "info",     "galhyp",
-	"quit",       "rand"	
+	"quit",       "rand",     "find",     "route",
+	"sim",        "npc",      "tick",     "arbitrage",
+	"plan",       "fill"
 };
 
 bool (*comfuncs[NUM_COMMANDS])(char *)=
@@ -246,7 +410,9 @@ bool (*comfuncs[NUM_COMMANDS])(char *)=
 	do_buy,         do_sell,       do_fuel,    do_jump,
 	do_cash,        do_market_display,        do_help,    do_hold,
 	do_sneak,       do_local_systems_display,      do_planet_info_display,    do_galactic_hyperspace,
-	do_quit,                              do_tweak_random_native
+	do_quit,                              do_tweak_random_native,             do_find,
+	do_route,       do_sim,        do_npc,     do_tick,
+	do_arbitrage,   do_plan,       do_fill
 };  
 
 /* ================= *
@@ -256,6 +422,20 @@ void port_srand(unsigned int);
 int port_rand(void);
 
 static unsigned int lastrand = 0;
+uint64_t RandCalls;  /* Native rand() state is hidden, so digests count calls instead */
+
+/* Step a private copy of the portable generator's state */
+int lcg_next(unsigned int *state)
+{
+	// As supplied by D McDonnell	from SAS Insititute C
+	unsigned int last = *state;
+	int r = (((((((((((last << 3) - last) << 3)
+									+ last) << 1) + last) << 4)
+						- last) << 1) - last) + 0xe60)
+		& 0x7fffffff;
+	*state = r - 1;
+	return r;
+}
 
 void my_srand(unsigned int initialSeed)
 {
@@ -267,16 +447,11 @@ int my_rand(void)
 {
 	int r;
 
+	RandCalls++;
 	if(NativeRand) 
 		r=rand();
 	else
-	{	// As supplied by D McDonnell	from SAS Insititute C
-		r = (((((((((((lastrand << 3) - lastrand) << 3)
-											+ lastrand) << 1) + lastrand) << 4)
-							- lastrand) << 1) - lastrand) + 0xe60)
-			& 0x7fffffff;
-		lastrand = r - 1;	
-	}
+		r = lcg_next(&lastrand);
 	return(r);
 }
 
@@ -315,6 +490,63 @@ void tweak_seed(struct SeedType *seedToTweak)
 	(*seedToTweak).w2 = temp;
 }
 
+/* ============================== *
+ * Money in tenths of a credit    *
+ * ============================== */
+
+#define MONEY_WIDTH (24) /* Formatted Money, terminator included */
+
+/* Add amount to total, saturating rather than wrapping; false if it had to */
+static inline bool money_add(Money *total, Money amount)
+{
+	Money sum;
+	if(!CHECKED_ADD(&sum, *total, amount)) { *total = sum; return true; }
+	*total = amount < 0 ? INT64_MIN : INT64_MAX;
+	return false;
+}
+
+/* Cost of units at a price, saturating */
+static inline Money money_times(Money price, int64_t units)
+{
+	Money product;
+	if(!CHECKED_MUL(&product, price, units)) return product;
+	return (price < 0) != (units < 0) ? INT64_MIN : INT64_MAX;
+}
+
+/*
+ * Read a decimal such as "+100", "-2.5" or "12.34" as tenths, truncating
+ * further digits toward zero as the old 10*atof() did; false if there is
+ * no number or it overflows.
+ */
+bool parse_tenths(const char *text, int64_t *tenths)
+{
+	bool negative = false, digits = false;
+	int64_t value = 0;
+
+	while(isspace((unsigned char)*text)) text++;
+	if(*text == '+' || *text == '-') negative = *text++ == '-';
+	for(; isdigit((unsigned char)*text); text++, digits = true)
+		if(CHECKED_MUL(&value, value, 10) || CHECKED_ADD(&value, value, *text - '0'))
+			return false;
+	if(CHECKED_MUL(&value, value, 10)) return false;
+	if(*text == '.' && isdigit((unsigned char)text[1]))
+	{
+		if(CHECKED_ADD(&value, value, text[1] - '0')) return false;
+		digits = true;
+	}
+	*tenths = negative ? -value : value;
+	return digits;
+}
+
+/* Write tenths as printf's %.1f would write them divided by ten */
+char *format_tenths(int64_t tenths, char *buffer)
+{
+	uint64_t magnitude = tenths < 0 ? 0 - (uint64_t)tenths : (uint64_t)tenths;
+	snprintf(buffer, MONEY_WIDTH, "%s%llu.%u", tenths < 0 ? "-" : "", (unsigned long long)(magnitude / 10),
+	         (unsigned)(magnitude % 10));
+	return buffer;
+}
+
 /* =================================== *
  * String functions for text interface *
  * =================================== */
@@ -334,7 +566,7 @@ void strip_char_from_string(char *inputString, const char charToStrip)
 }
 
 /* Return nonzero iff string t begins with non-empty string s */
-bool string_begins_with(char *prefixString, char *fullString)
+bool string_begins_with(char *prefixString, const char *fullString)
 {
 	size_t i=0;
 	size_t l=strlen(prefixString);
@@ -417,42 +649,43 @@ void split_string_at_first_space(char *inputString, char *firstWord)
  * Return ammount bought
  * Cannot buy more than is availble, can afford, or will fit in hold
  */
-uint16_t execute_buy_order(uint16_t itemIndex, uint16_t amount)
+uint16_t execute_buy_order(Commander *cmdr, uint16_t itemIndex, uint16_t amount)
 {
 	uint16_t t;
-	if(Cash < 0) t=0;
+	Money price = cmdr->localMarket.price[itemIndex];
+	if(cmdr->cash < 0) t=0;
 	else
 	{
-		t=minimum_value(LocalMarket.quantity[itemIndex],amount);
-		if ((Commodities[itemIndex].units)==TONNES) {t = minimum_value(HoldSpace,t);}
-		t = minimum_value(t, (uint16_t)floor((double)Cash/(LocalMarket.price[itemIndex])));
+		t=minimum_value(cmdr->localMarket.quantity[itemIndex],amount);
+		if ((Commodities[itemIndex].units)==TONNES) {t = minimum_value(cmdr->holdSpace,t);}
+		if (price > 0 && cmdr->cash / price < t) t = (uint16_t)(cmdr->cash / price);
 	}
-	ShipHold[itemIndex]+=t;
-	LocalMarket.quantity[itemIndex]-=t;
-	Cash-=t*(LocalMarket.price[itemIndex]);
+	cmdr->shipHold[itemIndex]+=t;
+	cmdr->localMarket.quantity[itemIndex]-=t;
+	money_add(&cmdr->cash, -money_times(price, t));
 	if ((Commodities[itemIndex].units)==TONNES)
-		HoldSpace-=t;
+		cmdr->holdSpace-=t;
 	return t;
 }
 
-uint16_t execute_sell_order(uint16_t itemIndex, uint16_t amount) /* As gamebuy but selling */
+uint16_t execute_sell_order(Commander *cmdr, uint16_t itemIndex, uint16_t amount) /* As gamebuy but selling */
 {
-	uint16_t t=minimum_value(ShipHold[itemIndex],amount);
-	ShipHold[itemIndex]-=t;
-	LocalMarket.quantity[itemIndex]+=t;
-	if ((Commodities[itemIndex].units)==TONNES) {HoldSpace+=t;}
-	Cash+=t*(LocalMarket.price[itemIndex]);
+	uint16_t t=minimum_value(cmdr->shipHold[itemIndex],amount);
+	cmdr->shipHold[itemIndex]-=t;
+	cmdr->localMarket.quantity[itemIndex]+=t;
+	if ((Commodities[itemIndex].units)==TONNES) {cmdr->holdSpace+=t;}
+	money_add(&cmdr->cash, money_times(cmdr->localMarket.price[itemIndex], t));
 	return t;
 }
 
-MarketType generate_market(uint16_t fluctuation, struct PlanSys planetSystem)
+MarketType generate_market(uint16_t fluctuation, uint16_t economy)
 {
 	MarketType market;
 	uint16_t i;
 	for(i=0;i<=LAST_TRADE;i++)
 	{
 		int32_t q; 
-		int32_t product = (planetSystem.economy)*(Commodities[i].gradient);
+		int32_t product = (economy)*(Commodities[i].gradient);
 		int32_t changing = fluctuation & (Commodities[i].maskByte);
 		q =  (Commodities[i].baseQuant) + changing - product;	
 		q = q&0xFF;
@@ -471,21 +704,186 @@ MarketType generate_market(uint16_t fluctuation, struct PlanSys planetSystem)
 void display_market_info(MarketType marketData)
 {
 	uint16_t i;
+	char price[MONEY_WIDTH];
 	for(i=0;i<=LAST_TRADE;i++)
 	{ printf("\n");
 		printf("%s", Commodities[i].name);
-		printf("   %.1f",((float)(marketData.price[i])/10));
+		printf("   %s",format_tenths(marketData.price[i],price));
 		printf("   %u",marketData.quantity[i]);
 		printf("%s", UnitNames[Commodities[i].units]);
-		printf("   %u",ShipHold[i]);
+		printf("   %u",Player.shipHold[i]);
 	}
 }	
 
+/* How much of each good the stock, the free hold and the cash allow buying */
+void affordable_units(const MarketType *market, Money cash, uint16_t holdSpace, int32_t *units)
+{
+	for(uint16_t i = 0; i <= LAST_TRADE; i++)
+	{
+		int32_t n = market->quantity[i];
+		if(Commodities[i].units == TONNES && n > holdSpace) n = holdSpace;
+		if((Money)n * market->price[i] > cash) n = cash > 0 ? (int32_t)(cash / market->price[i]) : 0;
+		units[i] = n;
+	}
+}
+
+/*
+ * Best good to carry from one market to another, given the units
+ * affordable at the first: sets item and returns the profit in tenths of a
+ * CR, or 0 if nothing pays. The first loop is straight-line over the goods.
+ */
+int32_t best_trade(const MarketType *here, const MarketType *there, const int32_t *units, uint16_t *item)
+{
+	int32_t profit[LAST_TRADE + 1], best = 0;
+
+	for(uint16_t i = 0; i <= LAST_TRADE; i++)
+		profit[i] = units[i] * ((int32_t)there->price[i] - (int32_t)here->price[i]);
+	for(uint16_t i = 0; i <= LAST_TRADE; i++)
+	{
+		if(profit[i] > best)
+		{
+			best = profit[i];
+			*item = i;
+		}
+	}
+	return best;
+}
+
+/* ======================================= *
+ * Knapsack for filling the hold at once   *
+ * ======================================= */
+
+#define FILL_NODE_LIMIT (1 << 22)
+
+/*
+ * Goods worth carrying to a target market, for a branch and bound search
+ * over how many of each to buy: tonnes use hold space, kg and g only cash.
+ */
+typedef struct {
+	uint16_t count;
+	uint16_t item[LAST_TRADE + 1];
+	int32_t price[LAST_TRADE + 1];
+	int32_t margin[LAST_TRADE + 1];     /* Resale less price, per unit */
+	int32_t limit[LAST_TRADE + 1];      /* Stock, capped by hold and cash */
+	bool tonnes[LAST_TRADE + 1];
+	uint16_t byCash[LAST_TRADE + 1];    /* Orders for the two relaxations */
+	uint16_t byHold[LAST_TRADE + 1];
+	int32_t take[LAST_TRADE + 1];
+	int32_t bestTake[LAST_TRADE + 1];
+	int64_t best;
+	uint32_t nodes;
+} Basket;
+
+/*
+ * Upper bound on the profit of goods k onwards: the lesser of two
+ * fractional knapsacks, one ignoring the hold and one ignoring the cash.
+ */
+double basket_bound(const Basket *basket, uint16_t k, Money cash, int32_t hold)
+{
+	double byCash = 0, byHold = 0, money = (double)cash, space = hold;
+
+	for(uint16_t j = 0; j < basket->count; j++)
+	{
+		uint16_t g = basket->byCash[j];
+		double n = basket->limit[g];
+		if(g < k) continue;
+		if(basket->price[g] > 0 && n * basket->price[g] > money) n = money / basket->price[g];
+		byCash += n * basket->margin[g];
+		money -= n * basket->price[g];
+	}
+	for(uint16_t j = 0; j < basket->count; j++)
+	{
+		uint16_t g = basket->byHold[j];
+		double n = basket->limit[g];
+		if(g < k) continue;
+		if(basket->tonnes[g])
+		{
+			if(n > space) n = space;
+			space -= n;
+		}
+		byHold += n * basket->margin[g];
+	}
+	return byCash < byHold ? byCash : byHold;
+}
+
+void basket_search(Basket *basket, uint16_t k, Money cash, int32_t hold, int64_t profit)
+{
+	int32_t most;
+
+	if(profit > basket->best)
+	{
+		basket->best = profit;
+		memcpy(basket->bestTake, basket->take, sizeof(basket->take));
+	}
+	if(k == basket->count || ++basket->nodes > FILL_NODE_LIMIT) return;
+	if(profit + basket_bound(basket, k, cash, hold) <= basket->best) return;
+
+	most = basket->limit[k];
+	if(basket->price[k] > 0 && most > cash / basket->price[k]) most = (int32_t)(cash / basket->price[k]);
+	if(basket->tonnes[k] && most > hold) most = hold;
+
+	for(int32_t n = most; n >= 0; n--)
+	{
+		basket->take[k] = n;
+		basket_search(basket, k + 1, cash - (Money)n * basket->price[k], basket->tonnes[k] ? hold - n : hold,
+		              profit + (int64_t)n * basket->margin[k]);
+	}
+	basket->take[k] = 0;
+}
+
+/* Choose how much of every good to buy here for resale at target; returns the profit */
+int64_t fill_basket(Basket *basket, const MarketType *here, const MarketType *target, Money cash, uint16_t holdSpace)
+{
+	memset(basket, 0, sizeof(*basket));
+	if(cash < 0) cash = 0;
+
+	for(uint16_t i = 0; i <= LAST_TRADE; i++)
+	{
+		uint16_t g = basket->count;
+		int32_t limit = here->quantity[i];
+		if(target->price[i] <= here->price[i] || limit == 0) continue;
+		if(Commodities[i].units == TONNES && limit > holdSpace) limit = holdSpace;
+		if(here->price[i] > 0 && limit > cash / here->price[i]) limit = (int32_t)(cash / here->price[i]);
+		if(limit == 0) continue;
+
+		basket->item[g] = i;
+		basket->price[g] = here->price[i];
+		basket->margin[g] = target->price[i] - here->price[i];
+		basket->limit[g] = limit;
+		basket->tonnes[g] = Commodities[i].units == TONNES;
+		basket->byCash[g] = basket->byHold[g] = g;
+		basket->count++;
+	}
+
+	/* Insertion sorts: margin per CR spent, and per tonne (kg and g first) */
+	for(uint16_t j = 1; j < basket->count; j++)
+	{
+		for(uint16_t m = j; m > 0; m--)
+		{
+			uint16_t a = basket->byCash[m - 1], b = basket->byCash[m];
+			if((int64_t)basket->margin[b] * basket->price[a] <= (int64_t)basket->margin[a] * basket->price[b]) break;
+			basket->byCash[m - 1] = b;
+			basket->byCash[m] = a;
+		}
+		for(uint16_t m = j; m > 0; m--)
+		{
+			uint16_t a = basket->byHold[m - 1], b = basket->byHold[m];
+			bool before = basket->tonnes[b] ? basket->tonnes[a] && basket->margin[b] > basket->margin[a] : basket->tonnes[a];
+			if(!before) break;
+			basket->byHold[m - 1] = b;
+			basket->byHold[m] = a;
+		}
+	}
+
+	basket_search(basket, 0, cash, holdSpace, 0);
+	return basket->best;
+}
+
 
 /* Generate system info from seed */
 struct PlanSys make_system(struct SeedType *initialSeed)
 {
-	struct PlanSys thissys;
+	struct PlanSys thissys = {0};
 	uint16_t pair1,pair2,pair3,pair4;
 	uint16_t longnameflag=((*initialSeed).w0)&64;
 
@@ -574,198 +972,3527 @@ void next_galaxy(struct SeedType *currentSeed)
 	(*currentSeed).w2 = twist((*currentSeed).w2);
 }
 
-/* Original game generated from scratch each time info needed */
+/* Original game generated from scratch each time info needed; now a table lookup */
 void build_galaxy_data(uint16_t galaxyNumber)
 {
-	uint16_t syscount,galcount;
-	Seed.w0=BASE_0; Seed.w1=BASE_1; Seed.w2=BASE_2; /* Initialise seed for galaxy 1 */
-	for(galcount=1;galcount<galaxyNumber;++galcount) next_galaxy(&Seed);
-	/* Put galaxy data into array of structures */  
-	for(syscount=0;syscount<GAL_SIZE;++syscount) Galaxy[syscount]=make_system(&Seed);
+	Galaxy = &Universe[galaxyNumber - 1];
 }
 
-/* ======================== *
- * Functions for navigation *
- * ======================== */
+static inline uint16_t sys_economy(SysAttrs attrs) { return attrs & 7; }
+static inline uint16_t sys_gov_type(SysAttrs attrs) { return (attrs >> 3) & 7; }
+static inline uint16_t sys_tech_lev(SysAttrs attrs) { return (attrs >> 6) & 15; }
 
-/* Move to system i */
-void execute_jump_to_planet(PlanetNum planetIndex)
+/* Copy a system's name, terminated, into a NAME_WIDTH+1 buffer */
+void get_system_name(const GalaxyColumns *galaxy, PlanetNum planetIndex, char *name)
 {
-	CurrentPlanet=planetIndex;
-	LocalMarket = generate_market(random_byte(),Galaxy[planetIndex]);
+	memcpy(name, galaxy->name[planetIndex], NAME_WIDTH);
+	name[NAME_WIDTH] = 0;
 }
 
-/* Seperation between two planets (4*sqrt(X*X+Y*Y/4)) */
-uint16_t distance(struct PlanSys systemA, struct PlanSys systemB)
+/* Store a generated system into its galaxy's columns */
+void pack_system(GalaxyColumns *galaxy, PlanetNum planetIndex, const struct PlanSys *planetSystem)
 {
-	return (uint16_t)float_to_int_round(4*sqrt((systemA.x-systemB.x)*(systemA.x-systemB.x)+(systemA.y-systemB.y)*(systemA.y-systemB.y)/4));
+	galaxy->coord[planetIndex] = (struct SysCoord){(uint8_t)planetSystem->x, (uint8_t)planetSystem->y};
+	galaxy->attrs[planetIndex] = (SysAttrs)(planetSystem->economy | (planetSystem->govType << 3) |
+		(planetSystem->techLev << 6) | (((planetSystem->radius >> 8) - 11) << 10));
+	galaxy->goatSoupSeed[planetIndex] = planetSystem->goatSoupSeed;
+	memset(galaxy->name[planetIndex], 0, NAME_WIDTH);
+	memcpy(galaxy->name[planetIndex], planetSystem->name, minimum_value(strlen(planetSystem->name), NAME_WIDTH));
 }
 
-
-/* Return id of the planet whose name matches passed strinmg
-   closest to currentplanet - if none return currentplanet */
-PlanetNum find_matching_system_name(char *searchName)
+/* Rebuild the full record for a system, deriving what make_system derives */
+struct PlanSys get_system(const GalaxyColumns *galaxy, PlanetNum planetIndex)
 {
-	PlanetNum syscount;
-	PlanetNum p=CurrentPlanet;
-	uint16_t d=9999;
-	for(syscount=0;syscount<GAL_SIZE;++syscount)
-	{ if (string_begins_with(searchName,Galaxy[syscount].name))
-		{	if (distance(Galaxy[syscount],Galaxy[CurrentPlanet])<d)
-			{ d=distance(Galaxy[syscount],Galaxy[CurrentPlanet]);
-				p=syscount;
-			}
-		}
-	}
-	return p;
+	struct PlanSys thissys = {0};
+	SysAttrs attrs = galaxy->attrs[planetIndex];
+
+	thissys.x = galaxy->coord[planetIndex].x;
+	thissys.y = galaxy->coord[planetIndex].y;
+	thissys.economy = sys_economy(attrs);
+	thissys.govType = sys_gov_type(attrs);
+	thissys.techLev = sys_tech_lev(attrs);
+	thissys.population = 4*(thissys.techLev) + (thissys.economy) + (thissys.govType) + 1;
+	thissys.productivity = (((thissys.economy)^7)+3)*((thissys.govType)+4)*(thissys.population)*8;
+	thissys.radius = 256*(((attrs >> 10) & 15)+11) + thissys.x;
+	thissys.goatSoupSeed = galaxy->goatSoupSeed[planetIndex];
+	get_system_name(galaxy, planetIndex, thissys.name);
+	return thissys;
 }
 
-
-/* Print data for given system */
-void print_system_info(struct PlanSys planetSystemInfo, bool useCompressedOutput)
+/* 
+ * Step the base seed on to the next galaxy. Twisting repeats after eight
+ * galaxies, so each further cycle of eight starts from a tweaked seed.
+ */
+void advance_galaxy_seed(struct SeedType *galaxySeed, uint16_t galcount)
 {
-	if (useCompressedOutput)
-	{	
-		//	  printf("\n ");
-		printf("%10s",planetSystemInfo.name);
-		printf(" TL: %2i ",(planetSystemInfo.techLev)+1);
-		printf("%12s",EconNames[planetSystemInfo.economy]);
-		printf(" %15s",GovNames[planetSystemInfo.govType]);
-	}
-	else
-	{	printf("\n\nSystem:  ");
-		printf("%s", planetSystemInfo.name);
-		printf("\nPosition (%i,",planetSystemInfo.x);
-		printf("%i)",planetSystemInfo.y);
-		printf("\nEconomy: (%i) ",planetSystemInfo.economy);
-		printf("%s", EconNames[planetSystemInfo.economy]);
-		printf("\nGovernment: (%i) ",planetSystemInfo.govType);
-		printf("%s", GovNames[planetSystemInfo.govType]);
-		printf("\nTech Level: %2i",(planetSystemInfo.techLev)+1);
-		printf("\nTurnover: %u",(planetSystemInfo.productivity));
-		printf("\nRadius: %u",planetSystemInfo.radius);
-		printf("\nPopulation: %u Billion",(planetSystemInfo.population)>>3);
-
-		RndSeed = planetSystemInfo.goatSoupSeed;
-		printf("\n");goat_soup("\x8F is \x97.",&planetSystemInfo);
-	}
+	next_galaxy(galaxySeed);
+	if(galcount % NUM_GALAXIES == NUM_GALAXIES - 1) tweak_seed(galaxySeed);
 }
 
-/* Various command functions */
-bool do_tweak_random_native(char *commandArguments) 
+/* Columns of galaxy galcount within a universe block */
+GalaxyColumns universe_columns(void *block, uint16_t galcount)
 {
-	(void)commandArguments; // Mark 's' as unused
-	NativeRand ^=1;
-	return true;
+	size_t systems = (size_t)GalaxyCount * GalaxySize;
+	size_t first = (size_t)galcount * GalaxySize;
+	struct SysCoord *coord = block;
+	SysAttrs *attrs = (SysAttrs *)(coord + systems);
+	struct FastSeedType *goatSoupSeed = (struct FastSeedType *)(attrs + systems);
+	char (*name)[NAME_WIDTH] = (char (*)[NAME_WIDTH])(goatSoupSeed + systems);
+	return (GalaxyColumns){coord + first, attrs + first, goatSoupSeed + first, name + first};
 }
 
-bool do_local_systems_display(char *commandArguments)
+size_t universe_bytes(void)
 {
-	uint16_t d = (uint16_t)atoi(commandArguments);
+	return (size_t)GalaxyCount * GalaxySize * UNIVERSE_BYTES_PER_SYSTEM;
+}
 
-	printf("Galaxy number %i",GalaxyNum);
-	for(PlanetNum syscount=0; syscount < GAL_SIZE; ++syscount)
+/* Generate every galaxy from the base seed into a universe block */
+void build_universe(void *block)
+{
+	GalaxyColumns galaxy;
+	struct SeedType galaxySeed = BaseSeed; /* Initialise seed for galaxy 1 */
+	for(uint16_t galcount = 0; galcount < GalaxyCount; ++galcount)
 	{
-		d=distance( Galaxy[syscount], Galaxy[CurrentPlanet] );
-
-		if(d <= MaxFuel)
+		struct SeedType systemSeed = galaxySeed; /* make_system advances its seed */
+		galaxy = universe_columns(block, galcount);
+		for(PlanetNum syscount = 0; syscount < GalaxySize; ++syscount)
 		{
-			if( d <= Fuel )
-				printf("\n * ");
-			else
-				printf("\n - ");
-
-			print_system_info( Galaxy[syscount], true );
-			printf(" (%.1f LY)", (float)d / 10);
+			struct PlanSys thissys = make_system(&systemSeed);
+			pack_system(&galaxy, syscount, &thissys);
 		}
+		advance_galaxy_seed(&galaxySeed, galcount);
 	}
-
-	return true;
 }
 
+/* ============================== *
+ * Universe files for custom seeds *
+ * ============================== */
 
-/* Jump to planet name s */
-bool do_jump(char *commandArguments)
+uint64_t checksum_bytes(const void *data, size_t size)
 {
-	uint16_t d;
-	PlanetNum dest=find_matching_system_name(commandArguments);
-
-	if(dest==CurrentPlanet)
+	const uint8_t *bytes = data;
+	uint64_t hash = 0xCBF29CE484222325u;
+	for(size_t i = 0; i < size; i++)
 	{
-		printf("\nBad jump");
-		return false;
+		hash ^= bytes[i];
+		hash *= 0x100000001B3u;
 	}
+	return hash;
+}
 
-	d=distance(Galaxy[dest],Galaxy[CurrentPlanet]);
+/* Universe files are keyed by seed, in $TXTELITE_UNIVERSE_DIR or the current directory */
+void universe_file_path(char *path, size_t size)
+{
+	const char *dir = getenv("TXTELITE_UNIVERSE_DIR");
+	snprintf(path, size, "%s%stxtelite-%04X%04X%04X-%ix%i-v%i.universe",
+	         dir ? dir : "", dir ? "/" : "", BaseSeed.w0, BaseSeed.w1, BaseSeed.w2,
+	         GalaxyCount, GalaxySize, UNIVERSE_FILE_VERSION);
+}
+
+/* Return true if the header describes a universe from this seed in this build's layout */
+bool universe_header_valid(const struct UniverseFileHeader *header, size_t fileSize)
+{
+	return memcmp(header->magic, UNIVERSE_FILE_MAGIC, sizeof(header->magic)) == 0 &&
+	       header->version == UNIVERSE_FILE_VERSION &&
+	       header->systemBytes == UNIVERSE_BYTES_PER_SYSTEM &&
+	       header->seed[0] == BaseSeed.w0 && header->seed[1] == BaseSeed.w1 && header->seed[2] == BaseSeed.w2 &&
+	       header->numGalaxies == GalaxyCount && header->galaxySize == (uint32_t)GalaxySize &&
+	       fileSize == sizeof(*header) + universe_bytes() &&
+	       header->checksum == checksum_bytes(header + 1, universe_bytes());
+}
 
-	if (d>Fuel)
+/* Map a universe file read-only, so every process shares the same pages; NULL if unusable */
+const void *map_universe_file(const char *path)
+{
+	const struct UniverseFileHeader *header;
+#ifdef _WIN32
+	/* No mmap: read a private copy instead */
+	FILE *file = fopen(path, "rb");
+	size_t size = sizeof(*header) + universe_bytes();
+	void *data;
+	if(file == NULL) return NULL;
+	data = malloc(size + 1);
+	if(data == NULL || fread(data, 1, size + 1, file) != size)
 	{
-		printf("\nJump to far");
-		return false;
+		free(data);
+		fclose(file);
+		return NULL;
 	}
-
-	Fuel-=d;
-	execute_jump_to_planet(dest);
-	print_system_info(Galaxy[CurrentPlanet],false);
-	return true;
+	fclose(file);
+	header = data;
+	if(!universe_header_valid(header, size))
+	{
+		free(data);
+		return NULL;
+	}
+#else
+	struct stat info;
+	void *data;
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) return NULL;
+	if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(*header))
+	{
+		close(fd);
+		return NULL;
+	}
+	data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED) return NULL;
+	header = data;
+	if(!universe_header_valid(header, (size_t)info.st_size))
+	{
+		munmap(data, (size_t)info.st_size);
+		return NULL;
+	}
+#endif
+	return header + 1;
 }
 
-/* As dojump but no fuel cost */
-bool do_sneak(char *commandArguments)
+/* Write the GeneratedUniverse block under a temporary name, then rename it into place */
+bool write_universe_file(const char *path)
 {
-	uint16_t fuelkeep=Fuel;
-	bool b;
-	Fuel=666;
-	b=do_jump(commandArguments);
-	Fuel=fuelkeep;
-	return b;
+	struct UniverseFileHeader header = {0};
+	char tempPath[FILENAME_MAX];
+	FILE *file;
+	bool ok;
+
+	memcpy(header.magic, UNIVERSE_FILE_MAGIC, sizeof(header.magic));
+	header.checksum = checksum_bytes(GeneratedUniverse, universe_bytes());
+	header.version = UNIVERSE_FILE_VERSION;
+	header.systemBytes = UNIVERSE_BYTES_PER_SYSTEM;
+	header.seed[0] = BaseSeed.w0; header.seed[1] = BaseSeed.w1; header.seed[2] = BaseSeed.w2;
+	header.numGalaxies = GalaxyCount;
+	header.galaxySize = (uint32_t)GalaxySize;
+
+	snprintf(tempPath, sizeof(tempPath), "%s.%i", path, (int)getpid());
+	file = fopen(tempPath, "wb");
+	if(file == NULL) return false;
+	ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+	     fwrite(GeneratedUniverse, universe_bytes(), 1, file) == 1;
+	ok = (fclose(file) == 0) && ok;
+#ifdef _WIN32
+	remove(path); /* rename does not replace on Windows */
+#endif
+	if(ok) ok = rename(tempPath, path) == 0;
+	if(!ok) remove(tempPath);
+	return ok;
 }
 
+/* Parse a base seed given as three hex words, eg. 5A4A:0248:B753 */
+bool parse_seed(const char *text, struct SeedType *seed)
+{
+	unsigned int w0, w1, w2;
+	char extra;
+	if(sscanf(text, "%x:%x:%x%c", &w0, &w1, &w2, &extra) != 3 || w0 > 0xFFFF || w1 > 0xFFFF || w2 > 0xFFFF)
+		return false;
+	seed->w0 = (uint16_t)w0; seed->w1 = (uint16_t)w1; seed->w2 = (uint16_t)w2;
+	return true;
+}
 
-/* Jump to next galaxy */
-bool do_galactic_hyperspace(char *commandArguments)
-/*
- * Preserve planetnum (eg. if leave 7th planet
- * arrive at 7th planet) 
- * Classic Elite always jumped to planet nearest (0x60,0x60)
+/* 
+ * Point Universe at the embedded tables if they match, else at the cached
+ * file for a custom seed (writing it first if need be), else generate it.
  */
+void load_universe(void)
 {
-	(void)(&commandArguments);     /* Discard s */
-	GalaxyNum++;
-	if(GalaxyNum==9) {GalaxyNum=1;}
-	build_galaxy_data(GalaxyNum);
-	return true;
+	char path[FILENAME_MAX];
+	void *block = NULL;
+
+	Universe = malloc(GalaxyCount * sizeof(GalaxyColumns));
+	JumpGraphs = calloc(GalaxyCount, sizeof(JumpGraph));
+	GalaxyLookups = calloc(GalaxyCount, sizeof(GalaxyLookup));
+	if(Universe == NULL || JumpGraphs == NULL || GalaxyLookups == NULL) stop("Out of memory");
+
+#ifdef HAVE_EMBEDDED_UNIVERSE
+	if(EMBEDDED_UNIVERSE_BASE_0 == BaseSeed.w0 && EMBEDDED_UNIVERSE_BASE_1 == BaseSeed.w1 &&
+	   EMBEDDED_UNIVERSE_BASE_2 == BaseSeed.w2 && EMBEDDED_UNIVERSE_GALAXIES == GalaxyCount &&
+	   EMBEDDED_UNIVERSE_GALAXY_SIZE == GalaxySize &&
+	   EMBEDDED_UNIVERSE_BYTES_PER_SYSTEM == UNIVERSE_BYTES_PER_SYSTEM)
+		block = (void *)EmbeddedUniverse; /* Never written through */
+#endif
+	if(block == NULL && CustomSeed)
+	{
+		universe_file_path(path, sizeof(path));
+		block = (void *)map_universe_file(path); /* Mapped read-only */
+	}
+	if(block == NULL)
+	{
+		GeneratedUniverse = malloc(universe_bytes());
+		if(GeneratedUniverse == NULL) stop("Out of memory");
+		build_universe(GeneratedUniverse);
+		block = GeneratedUniverse;
+		if(CustomSeed)
+		{
+			if(!write_universe_file(path))
+				fprintf(stderr, "Cannot write universe file %s\n", path);
+			else if((block = (void *)map_universe_file(path)) != NULL)
+			{
+				free(GeneratedUniverse);
+				GeneratedUniverse = NULL;
+			}
+			else block = GeneratedUniverse;
+		}
+	}
+
+	for(uint16_t galcount = 0; galcount < GalaxyCount; ++galcount)
+		Universe[galcount] = universe_columns(block, galcount);
 }
 
-/* Info on planet */
-bool do_planet_info_display(char *commandArguments)
+/* Regenerate the universe and compare it with the loaded one */
+bool verify_universe(void)
 {
-	PlanetNum dest=find_matching_system_name(commandArguments);
-	print_system_info(Galaxy[dest],false);
+	struct SeedType galaxySeed = BaseSeed;
+	for(uint16_t galcount = 0; galcount < GalaxyCount; ++galcount)
+	{
+		struct SeedType systemSeed = galaxySeed;
+		for(PlanetNum syscount = 0; syscount < GalaxySize; ++syscount)
+		{
+			struct PlanSys generated = make_system(&systemSeed);
+			struct PlanSys loaded = get_system(&Universe[galcount], syscount);
+			const struct PlanSys *a = &generated, *b = &loaded;
+			if(a->x != b->x || a->y != b->y || a->economy != b->economy ||
+			   a->govType != b->govType || a->techLev != b->techLev ||
+			   a->population != b->population || a->productivity != b->productivity ||
+			   a->radius != b->radius || memcmp(&a->goatSoupSeed, &b->goatSoupSeed, sizeof(a->goatSoupSeed)) != 0 ||
+			   strcmp(a->name, b->name) != 0)
+			{
+				printf("Universe mismatch at galaxy %i system %i\n", galcount + 1, syscount);
+				return false;
+			}
+		}
+		advance_galaxy_seed(&galaxySeed, galcount);
+	}
 	return true;
 }
 
-
-bool do_hold(char *commandArguments)
+/* Write the generated universe as a C header for embedding */
+void emit_universe(void)
 {
-	uint16_t a=(uint16_t)atoi(commandArguments);
-	uint16_t t=0;
-
-	for(uint16_t i = 0; i <= LAST_TRADE; ++i)
+	size_t systems = (size_t)GalaxyCount * GalaxySize;
+	void *block = malloc(universe_bytes());
+	GalaxyColumns columns;
+
+	if(block == NULL) stop("Out of memory");
+	build_universe(block);
+	columns = universe_columns(block, 0); /* Columns run on through every galaxy */
+
+	printf("/* Generated by txtelite --emit-universe; do not edit */\n\n");
+	printf("#define EMBEDDED_UNIVERSE_BASE_0 0x%04X\n", BaseSeed.w0);
+	printf("#define EMBEDDED_UNIVERSE_BASE_1 0x%04X\n", BaseSeed.w1);
+	printf("#define EMBEDDED_UNIVERSE_BASE_2 0x%04X\n", BaseSeed.w2);
+	printf("#define EMBEDDED_UNIVERSE_GALAXIES %i\n", GalaxyCount);
+	printf("#define EMBEDDED_UNIVERSE_GALAXY_SIZE %i\n", GalaxySize);
+	printf("#define EMBEDDED_UNIVERSE_BYTES_PER_SYSTEM %zu\n\n", UNIVERSE_BYTES_PER_SYSTEM);
+
+	/* Same layout as a universe block: each column for every galaxy in turn */
+	printf("static const struct {\n");
+	printf("    struct SysCoord coord[%zu];\n", systems);
+	printf("    SysAttrs attrs[%zu];\n", systems);
+	printf("    struct FastSeedType goatSoupSeed[%zu];\n", systems);
+	printf("    char name[%zu][NAME_WIDTH];\n", systems);
+	printf("} EmbeddedUniverse[1] = {{\n  .coord = {");
+	for(size_t i = 0; i < systems; ++i)
+		printf("%s{%u,%u},", i % 8 ? "" : "\n    ", columns.coord[i].x, columns.coord[i].y);
+	printf("\n  },\n  .attrs = {");
+	for(size_t i = 0; i < systems; ++i)
+		printf("%s0x%04X,", i % 8 ? "" : "\n    ", columns.attrs[i]);
+	printf("\n  },\n  .goatSoupSeed = {");
+	for(size_t i = 0; i < systems; ++i)
 	{
-		if (( Commodities[i].units ) == TONNES)
-			t += ShipHold[i];
+		const struct FastSeedType *seed = &columns.goatSoupSeed[i];
+		printf("%s{%u,%u,%u,%u},", i % 4 ? "" : "\n    ", seed->a, seed->b, seed->c, seed->d);
 	}
-
-	if( t > a )
+	printf("\n  },\n  .name = {");
+	for(size_t i = 0; i < systems; ++i)
 	{
-		printf("\nHold too full");
-		return false;
+		printf("%s{", i % 4 ? "" : "\n    ");
+		for(uint16_t j = 0; j < NAME_WIDTH; j++)
+			printf(columns.name[i][j] ? "'%c'," : "%u,", columns.name[i][j]);
+		printf("},");
 	}
+	printf("\n  },\n}};\n");
+	free(block);
+}
 
-	HoldSpace=a - t;
+/* ======================== *
+ * Functions for navigation *
+ * ======================== */
 
-	return true;
+/* Move to system i */
+void execute_jump_to_planet(Commander *cmdr, PlanetNum planetIndex, uint16_t fluctuation)
+{
+	cmdr->currentPlanet=planetIndex;
+	cmdr->fluctuation=(uint8_t)fluctuation;
+	cmdr->localMarket = generate_market(fluctuation,sys_economy(Universe[cmdr->galaxyNum - 1].attrs[planetIndex]));
+}
+
+/* Seperation between two planets (4*sqrt(X*X+Y*Y/4)) */
+uint16_t distance(struct SysCoord systemA, struct SysCoord systemB)
+{
+	return (uint16_t)float_to_int_round(4*sqrt((systemA.x-systemB.x)*(systemA.x-systemB.x)+(systemA.y-systemB.y)*(systemA.y-systemB.y)/4));
+}
+
+
+/* ===================================== *
+ * Name and coordinate lookup per galaxy *
+ * ===================================== */
+
+/* Stable radix sort of a galaxy's systems by name, one byte per pass */
+void sort_by_name(const GalaxyColumns *galaxy, PlanetNum *order)
+{
+	PlanetNum *from = order, *to = malloc(GalaxySize * sizeof(PlanetNum)), *swap;
+	if(to == NULL) stop("Out of memory");
+
+	for(PlanetNum i = 0; i < GalaxySize; i++) order[i] = i;
+	for(int byte = NAME_WIDTH - 1; byte >= 0; byte--)
+	{
+		uint32_t count[257] = {0};
+		for(PlanetNum i = 0; i < GalaxySize; i++) count[(uint8_t)galaxy->name[from[i]][byte] + 1]++;
+		for(uint16_t c = 1; c <= 256; c++) count[c] += count[c - 1];
+		for(PlanetNum i = 0; i < GalaxySize; i++) to[count[(uint8_t)galaxy->name[from[i]][byte]]++] = from[i];
+		swap = from; from = to; to = swap;
+	}
+	free(to); /* An even number of passes leaves the result in order[] */
+}
+
+/* Name index and coordinate grid for galaxy n, built on first use */
+const GalaxyLookup *galaxy_lookup(uint16_t galaxyNumber)
+{
+	GalaxyLookup *lookup = &GalaxyLookups[galaxyNumber - 1];
+	const GalaxyColumns *galaxy = &Universe[galaxyNumber - 1];
+
+	if(lookup->built) return lookup;
+	lookup->byName = malloc(GalaxySize * sizeof(PlanetNum));
+	lookup->byCell = malloc(GalaxySize * sizeof(PlanetNum));
+	if(lookup->byName == NULL || lookup->byCell == NULL) stop("Out of memory");
+
+	sort_by_name(galaxy, lookup->byName);
+
+	/* Counting sort into cells keeps each cell in ascending order */
+	memset(lookup->cellStart, 0, sizeof(lookup->cellStart));
+	for(PlanetNum i = 0; i < GalaxySize; i++)
+		lookup->cellStart[(galaxy->coord[i].y >> GRID_SHIFT) * GRID_DIM + (galaxy->coord[i].x >> GRID_SHIFT) + 1]++;
+	for(uint16_t c = 1; c <= GRID_DIM * GRID_DIM; c++) lookup->cellStart[c] += lookup->cellStart[c - 1];
+	{
+		uint32_t fill[GRID_DIM * GRID_DIM];
+		memcpy(fill, lookup->cellStart, sizeof(fill));
+		for(PlanetNum i = 0; i < GalaxySize; i++)
+			lookup->byCell[fill[(galaxy->coord[i].y >> GRID_SHIFT) * GRID_DIM + (galaxy->coord[i].x >> GRID_SHIFT)]++] = i;
+	}
+
+	lookup->built = true;
+	return lookup;
+}
+
+/* 
+ * Collect the systems of galaxy n within maxDistance of centre (itself
+ * included) into out[], in ascending order; return how many. marks must
+ * hold GalaxySize zero bits and is left zeroed.
+ */
+PlanetNum systems_within(uint16_t galaxyNumber, PlanetNum centre, uint16_t maxDistance, PlanetNum *out, uint64_t *marks)
+{
+	const GalaxyColumns *galaxy = &Universe[galaxyNumber - 1];
+	const GalaxyLookup *lookup = galaxy_lookup(galaxyNumber);
+	struct SysCoord c = galaxy->coord[centre];
+	/* distance() is 4*|dx| along x but only 2*|dy| along y; pad for rounding */
+	int reachX = maxDistance / 4 + 1, reachY = maxDistance / 2 + 2;
+	int cellX0 = (c.x - reachX < 0 ? 0 : c.x - reachX) >> GRID_SHIFT;
+	int cellX1 = (c.x + reachX > 255 ? 255 : c.x + reachX) >> GRID_SHIFT;
+	int cellY0 = (c.y - reachY < 0 ? 0 : c.y - reachY) >> GRID_SHIFT;
+	int cellY1 = (c.y + reachY > 255 ? 255 : c.y + reachY) >> GRID_SHIFT;
+	PlanetNum lowest = GalaxySize, highest = 0, found = 0;
+
+	for(int cy = cellY0; cy <= cellY1; cy++)
+	{
+		for(int cx = cellX0; cx <= cellX1; cx++)
+		{
+			uint32_t cell = cy * GRID_DIM + cx;
+			for(uint32_t k = lookup->cellStart[cell]; k < lookup->cellStart[cell + 1]; k++)
+			{
+				PlanetNum i = lookup->byCell[k];
+				if(distance(galaxy->coord[i], c) > maxDistance) continue;
+				marks[i / 64] |= (uint64_t)1 << (i % 64);
+				if(i < lowest) lowest = i;
+				if(i > highest) highest = i;
+			}
+		}
+	}
+
+	/* Read the marks back in index order, clearing them */
+	for(PlanetNum w = lowest / 64; lowest <= highest && w <= highest / 64; w++)
+	{
+		uint64_t bits = marks[w];
+		marks[w] = 0;
+		while(bits)
+		{
+			out[found++] = w * 64 + __builtin_ctzll(bits);
+			bits &= bits - 1;
+		}
+	}
+	return found;
+}
+
+/* Allocate a zeroed GalaxySize-bit scratch area for systems_within */
+uint64_t *new_system_marks(void)
+{
+	uint64_t *marks = calloc((GalaxySize + 63) / 64, sizeof(uint64_t));
+	if(marks == NULL) stop("Out of memory");
+	return marks;
+}
+
+/*
+ * Levenshtein distance from a query to a zero-padded name, by Myers'
+ * bit-vector method: peq[c] has bit i set where the query's i-th letter is
+ * c, and each letter of the name updates a whole column of the dynamic
+ * programming table in a handful of word operations.
+ */
+static inline uint32_t name_edit_distance(const uint64_t *peq, uint32_t length, const char *name)
+{
+	uint64_t pv = ~(uint64_t)0, mv = 0, last = (uint64_t)1 << (length - 1);
+	uint32_t score = length;
+
+	for(size_t i = 0; i < NAME_WIDTH && name[i]; i++)
+	{
+		uint64_t eq = peq[(unsigned char)name[i]];
+		uint64_t xv = eq | mv;
+		uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+		uint64_t ph = mv | ~(xh | pv);
+		uint64_t mh = pv & xh;
+		if(ph & last) score++;
+		else if(mh & last) score--;
+		ph = ph << 1 | 1;  /* Row 0 costs one per letter of the name */
+		mh <<= 1;
+		pv = mh | ~(xv | ph);
+		mv = ph & xv;
+	}
+	return score;
+}
+
+/* The galaxy's system nearest by name to the query, closest to from on ties; sets its edit distance */
+PlanetNum closest_name(uint16_t galaxyNumber, const uint64_t *peq, uint32_t length, PlanetNum from, uint32_t *best)
+{
+	const GalaxyColumns *galaxy = &Universe[galaxyNumber - 1];
+	PlanetNum p = from;
+	uint16_t d = 9999;
+
+	*best = UINT32_MAX;
+	for(PlanetNum i = 0; i < GalaxySize; i++)
+	{
+		uint32_t score = name_edit_distance(peq, length, galaxy->name[i]);
+		uint16_t dist;
+		if(score > *best) continue;
+		dist = distance(galaxy->coord[i], galaxy->coord[from]);
+		if(score < *best || dist < d)  /* Ascending scan, so the first in galaxy order wins ties */
+		{
+			*best = score;
+			d = dist;
+			p = i;
+		}
+	}
+	return p;
+}
+
+/* Return id of the planet whose name matches passed strinmg
+   closest to currentplanet - if none return currentplanet.
+   Failing any prefix, the name fewest edits away will do. */
+PlanetNum find_matching_system_name(char *searchName)
+{
+	const GalaxyLookup *lookup = galaxy_lookup(Player.galaxyNum);
+	size_t length = strlen(searchName);
+	char key[FUZZY_MAX_QUERY];
+	uint64_t peq[256] = {0};
+	uint32_t edits, allowed;
+	PlanetNum p = Player.currentPlanet;
+	uint16_t d = 9999;
+	PlanetNum lo = 0, hi = GalaxySize;
+
+	if(length == 0 || length > FUZZY_MAX_QUERY) return p;
+	for(size_t i = 0; i < length; i++) key[i] = (char)toupper(searchName[i]);
+
+	/* Names are sorted, so the prefix matches form one run */
+	while(length <= NAME_WIDTH && lo < hi)
+	{
+		PlanetNum mid = lo + (hi - lo) / 2;
+		if(memcmp(Galaxy->name[lookup->byName[mid]], key, length) < 0) lo = mid + 1;
+		else hi = mid;
+	}
+	for(; length <= NAME_WIDTH && lo < GalaxySize && memcmp(Galaxy->name[lookup->byName[lo]], key, length) == 0; lo++)
+	{
+		PlanetNum syscount = lookup->byName[lo];
+		uint16_t dist = distance(Galaxy->coord[syscount], Galaxy->coord[Player.currentPlanet]);
+		if(dist < d || (dist == d && syscount < p)) /* First in galaxy order wins ties */
+		{
+			d = dist;
+			p = syscount;
+		}
+	}
+	if(d != 9999) return p;
+
+	/* No prefix: take the fewest edits, if few enough to be a typo */
+	for(size_t i = 0; i < length; i++) peq[(unsigned char)key[i]] |= (uint64_t)1 << i;
+	allowed = (uint32_t)(length + 2) / 3;
+	p = closest_name(Player.galaxyNum, peq, (uint32_t)length, Player.currentPlanet, &edits);
+	if(edits <= allowed) return p;
+
+	/* Say if another galaxy has it */
+	for(uint16_t g = 1; g <= GalaxyCount; g++)
+	{
+		char name[NAME_WIDTH + 1];
+		PlanetNum there;
+		if(g == Player.galaxyNum) continue;
+		there = closest_name(g, peq, (uint32_t)length, 0, &edits);
+		if(edits > allowed) continue;
+		get_system_name(&Universe[g - 1], there, name);
+		printf("\n%s is in galaxy %u", name, g);
+		break;
+	}
+	return Player.currentPlanet;
+}
+
+
+/* ============================== *
+ * Jump graph and route planning  *
+ * ============================== */
+
+/* Link every pair of systems no more than MaxFuel apart, then label components */
+void build_jump_graph(JumpGraph *graph, uint16_t galaxyNumber)
+{
+	const GalaxyColumns *galaxy = &Universe[galaxyNumber - 1];
+	PlanetNum *near = malloc(GalaxySize * sizeof(PlanetNum));
+	PlanetNum *queue = malloc(GalaxySize * sizeof(PlanetNum));
+	uint64_t *marks = new_system_marks();
+	uint32_t edges = 0, capacity = GalaxySize * 16;
+
+	graph->offset = malloc((GalaxySize + 1) * sizeof(uint32_t));
+	graph->component = malloc(GalaxySize * sizeof(uint32_t));
+	graph->neighbour = malloc(capacity * sizeof(PlanetNum));
+	graph->hopDistance = malloc(capacity);
+	if(near == NULL || queue == NULL || graph->offset == NULL || graph->component == NULL ||
+	   graph->neighbour == NULL || graph->hopDistance == NULL) stop("Out of memory");
+
+	for(PlanetNum i = 0; i < GalaxySize; i++)
+	{
+		PlanetNum count = systems_within(galaxyNumber, i, (uint16_t)MaxFuel, near, marks);
+		graph->offset[i] = edges;
+		if(edges + count > capacity)
+		{
+			while(edges + count > capacity) capacity *= 2;
+			graph->neighbour = realloc(graph->neighbour, capacity * sizeof(PlanetNum));
+			graph->hopDistance = realloc(graph->hopDistance, capacity);
+			if(graph->neighbour == NULL || graph->hopDistance == NULL) stop("Out of memory");
+		}
+		for(PlanetNum k = 0; k < count; k++)
+		{
+			if(near[k] == i) continue;
+			graph->neighbour[edges] = near[k];
+			graph->hopDistance[edges] = (uint8_t)distance(galaxy->coord[i], galaxy->coord[near[k]]);
+			edges++;
+		}
+	}
+	graph->offset[GalaxySize] = edges;
+
+	/* Breadth-first flood from each unlabelled system */
+	for(PlanetNum i = 0; i < GalaxySize; i++) graph->component[i] = UINT32_MAX;
+	graph->numComponents = 0;
+	for(PlanetNum i = 0; i < GalaxySize; i++)
+	{
+		PlanetNum head = 0, tail = 0;
+		if(graph->component[i] != UINT32_MAX) continue;
+		graph->component[i] = graph->numComponents;
+		queue[tail++] = i;
+		while(head < tail)
+		{
+			PlanetNum at = queue[head++];
+			for(uint32_t e = graph->offset[at]; e < graph->offset[at + 1]; e++)
+			{
+				PlanetNum next = graph->neighbour[e];
+				if(graph->component[next] == UINT32_MAX)
+				{
+					graph->component[next] = graph->numComponents;
+					queue[tail++] = next;
+				}
+			}
+		}
+		graph->numComponents++;
+	}
+
+	free(near);
+	free(queue);
+	free(marks);
+}
+
+/* Jump graph for galaxy n, built on first use */
+const JumpGraph *jump_graph(uint16_t galaxyNumber)
+{
+	JumpGraph *graph = &JumpGraphs[galaxyNumber - 1];
+	if(!graph->built)
+	{
+		build_jump_graph(graph, galaxyNumber);
+		graph->built = true;
+	}
+	return graph;
+}
+
+/* Fewest-jumps path by breadth-first search; fills previous[], returns success */
+bool route_fewest_jumps(const JumpGraph *graph, PlanetNum from, PlanetNum to, PlanetNum *previous)
+{
+	PlanetNum *queue;
+	PlanetNum head = 0, tail = 0;
+	bool found = false;
+
+	if(graph->component[from] != graph->component[to]) return false;
+	queue = malloc(GalaxySize * sizeof(PlanetNum));
+	if(queue == NULL) stop("Out of memory");
+
+	for(PlanetNum i = 0; i < GalaxySize; i++) previous[i] = -1;
+	previous[from] = from;
+	queue[tail++] = from;
+	while(head < tail)
+	{
+		PlanetNum at = queue[head++];
+		if(at == to) { found = true; break; }
+		for(uint32_t e = graph->offset[at]; e < graph->offset[at + 1]; e++)
+		{
+			PlanetNum next = graph->neighbour[e];
+			if(previous[next] == -1)
+			{
+				previous[next] = at;
+				queue[tail++] = next;
+			}
+		}
+	}
+
+	free(queue);
+	return found;
+}
+
+struct RouteStep {
+    uint32_t cost;
+    PlanetNum at;
+};
+
+/* Least-fuel path by Dijkstra over a binary heap; fills previous[], returns success */
+bool route_least_fuel(const JumpGraph *graph, PlanetNum from, PlanetNum to, PlanetNum *previous)
+{
+	uint32_t *best;
+	struct RouteStep *heap, item, swap;
+	uint32_t heapSize = 0, heapCapacity = GalaxySize;
+	bool found = false;
+
+	if(graph->component[from] != graph->component[to]) return false;
+
+	best = malloc(GalaxySize * sizeof(uint32_t));
+	heap = malloc(heapCapacity * sizeof(struct RouteStep));
+	if(best == NULL || heap == NULL) stop("Out of memory");
+
+	for(PlanetNum i = 0; i < GalaxySize; i++) { best[i] = UINT32_MAX; previous[i] = -1; }
+	best[from] = 0;
+	previous[from] = from;
+	heap[heapSize++] = (struct RouteStep){0, from};
+
+	while(heapSize > 0)
+	{
+		/* Pop the cheapest entry */
+		uint32_t i = 0;
+		item = heap[0];
+		heap[0] = heap[--heapSize];
+		for(;;)
+		{
+			uint32_t child = 2 * i + 1, smallest = i;
+			if(child < heapSize && heap[child].cost < heap[smallest].cost) smallest = child;
+			if(child + 1 < heapSize && heap[child + 1].cost < heap[smallest].cost) smallest = child + 1;
+			if(smallest == i) break;
+			swap = heap[i]; heap[i] = heap[smallest]; heap[smallest] = swap;
+			i = smallest;
+		}
+
+		if(item.at == to) { found = true; break; }
+		if(item.cost > best[item.at]) continue; /* Stale entry */
+
+		for(uint32_t e = graph->offset[item.at]; e < graph->offset[item.at + 1]; e++)
+		{
+			PlanetNum next = graph->neighbour[e];
+			uint32_t cost = item.cost + graph->hopDistance[e];
+			if(cost >= best[next]) continue;
+			best[next] = cost;
+			previous[next] = item.at;
+
+			/* Push and sift up */
+			if(heapSize == heapCapacity)
+			{
+				heapCapacity *= 2;
+				heap = realloc(heap, heapCapacity * sizeof(struct RouteStep));
+				if(heap == NULL) stop("Out of memory");
+			}
+			i = heapSize++;
+			heap[i] = (struct RouteStep){cost, next};
+			while(i > 0 && heap[(i - 1) / 2].cost > heap[i].cost)
+			{
+				swap = heap[i]; heap[i] = heap[(i - 1) / 2]; heap[(i - 1) / 2] = swap;
+				i = (i - 1) / 2;
+			}
+		}
+	}
+
+	free(best);
+	free(heap);
+	return found;
+}
+
+/* Print the path ending at to, as recorded in previous[] */
+void print_route(const char *title, PlanetNum to, const PlanetNum *previous)
+{
+	PlanetNum *path = malloc(GalaxySize * sizeof(PlanetNum));
+	PlanetNum hops = 0;
+	uint32_t total = 0;
+	char cost[MONEY_WIDTH];
+
+	if(path == NULL) stop("Out of memory");
+	for(PlanetNum at = to; previous[at] != at; at = previous[at]) path[hops++] = at;
+
+	for(PlanetNum i = hops; i > 0; i--)
+		total += distance(Galaxy->coord[path[i - 1]], Galaxy->coord[i == hops ? Player.currentPlanet : path[i]]);
+	printf("\n%s: %i jumps, %.1f LY, %s CR fuel", title, hops, (float)total / 10,
+	       format_tenths(money_times(FuelCost, total), cost));
+
+	for(PlanetNum i = hops; i > 0; i--)
+	{
+		printf("\n   ");
+		print_system_info(Galaxy, path[i - 1], true);
+		printf(" (%.1f LY)", (float)distance(Galaxy->coord[path[i - 1]], Galaxy->coord[i == hops ? Player.currentPlanet : path[i]]) / 10);
+	}
+	free(path);
+}
+
+
+/* Print data for given system */
+void print_system_info(const GalaxyColumns *galaxy, PlanetNum planetIndex, bool useCompressedOutput)
+{
+	struct PlanSys planetSystemInfo = get_system(galaxy, planetIndex);
+	if (useCompressedOutput)
+	{	
+		//	  printf("\n ");
+		printf("%10s",planetSystemInfo.name);
+		printf(" TL: %2i ",(planetSystemInfo.techLev)+1);
+		printf("%12s",EconNames[planetSystemInfo.economy]);
+		printf(" %15s",GovNames[planetSystemInfo.govType]);
+	}
+	else
+	{	printf("\n\nSystem:  ");
+		printf("%s", planetSystemInfo.name);
+		printf("\nPosition (%i,",planetSystemInfo.x);
+		printf("%i)",planetSystemInfo.y);
+		printf("\nEconomy: (%i) ",planetSystemInfo.economy);
+		printf("%s", EconNames[planetSystemInfo.economy]);
+		printf("\nGovernment: (%i) ",planetSystemInfo.govType);
+		printf("%s", GovNames[planetSystemInfo.govType]);
+		printf("\nTech Level: %2i",(planetSystemInfo.techLev)+1);
+		printf("\nTurnover: %u",(planetSystemInfo.productivity));
+		printf("\nRadius: %u",planetSystemInfo.radius);
+		printf("\nPopulation: %u Billion",(planetSystemInfo.population)>>3);
+
+		Description description;
+		system_description(galaxy, planetIndex, &description);
+		printf("\n%s", description.text);
+	}
+}
+
+/* ================================ *
+ * Bitmap indexes for system queries *
+ * ================================ */
+
+void set_clear(SystemSet *set)
+{
+	memset(set->bits, 0, SetWords * sizeof(uint64_t));
+}
+
+void set_fill(SystemSet *set)
+{
+	memset(set->bits, 0xFF, SetWords * sizeof(uint64_t));
+}
+
+void set_and(SystemSet *target, const SystemSet *other)
+{
+	for(uint32_t w = 0; w < SetWords; w++) target->bits[w] &= other->bits[w];
+}
+
+void set_or(SystemSet *target, const SystemSet *other)
+{
+	for(uint32_t w = 0; w < SetWords; w++) target->bits[w] |= other->bits[w];
+}
+
+void set_not(SystemSet *target)
+{
+	uint32_t systems = (uint32_t)GalaxyCount * GalaxySize;
+	for(uint32_t w = 0; w < SetWords; w++) target->bits[w] = ~target->bits[w];
+	if(systems % 64) target->bits[SetWords - 1] &= ((uint64_t)1 << (systems % 64)) - 1;
+}
+
+void set_add(SystemSet *set, uint32_t systemBit)
+{
+	set->bits[systemBit / 64] |= (uint64_t)1 << (systemBit % 64);
+}
+
+SystemSet set_new(void)
+{
+	SystemSet set = {malloc(SetWords * sizeof(uint64_t))};
+	if(set.bits == NULL) stop("Out of memory");
+	set_clear(&set);
+	return set;
+}
+
+/* Build the attribute indexes from Universe[] on first use */
+void build_universe_index(void)
+{
+	if(UniverseIndexBuilt) return;
+	UniverseIndexBuilt = true;
+
+	SetWords = (uint32_t)(((size_t)GalaxyCount * GalaxySize + 63) / 64);
+	for(uint16_t i = 0; i < 8; i++) { EconomyIndex[i] = set_new(); GovIndex[i] = set_new(); }
+	for(uint16_t i = 0; i < NUM_TECH_LEVELS; i++) TechIndex[i] = set_new();
+	for(uint16_t i = 0; i < NUM_POP_BANDS; i++) PopIndex[i] = set_new();
+
+	for(uint16_t galcount = 0; galcount < GalaxyCount; galcount++)
+	{
+		for(PlanetNum syscount = 0; syscount < GalaxySize; syscount++)
+		{
+			SysAttrs attrs = Universe[galcount].attrs[syscount];
+			uint32_t systemBit = (uint32_t)galcount * GalaxySize + syscount;
+			uint16_t population = 4*sys_tech_lev(attrs) + sys_economy(attrs) + sys_gov_type(attrs) + 1;
+			set_add(&EconomyIndex[sys_economy(attrs)], systemBit);
+			set_add(&GovIndex[sys_gov_type(attrs)], systemBit);
+			set_add(&TechIndex[sys_tech_lev(attrs)], systemBit);
+			set_add(&PopIndex[minimum_value(population >> 3, NUM_POP_BANDS - 1)], systemBit);
+		}
+	}
+}
+
+/* 
+ * Union of index[lo..hi] selected by a term such as "t10", "t10+" or "t10-".
+ * The number is offset by bias (tech levels are displayed from 1).
+ */
+bool query_range(char *term, SystemSet *index, int16_t indexSize, int16_t bias, SystemSet *result)
+{
+	char *end;
+	long value = strtol(term, &end, 10);
+	int16_t lo, hi;
+
+	if(end == term) return false;
+	value -= bias;
+	if(value < 0 || value >= indexSize) return false;
+
+	lo = hi = (int16_t)value;
+	if(*end == '+') { hi = indexSize - 1; end++; }
+	else if(*end == '-') { lo = 0; end++; }
+	if(*end != '\0') return false;
+
+	set_clear(result);
+	for(int16_t i = lo; i <= hi; i++) set_or(result, &index[i]);
+	return true;
+}
+
+/* Evaluate one query term into result; return false if not understood */
+bool query_term(char *term, SystemSet *result)
+{
+	switch(tolower(term[0]))
+	{
+		case 'e': return query_range(term + 1, EconomyIndex, 8, 0, result);
+		case 'g': return query_range(term + 1, GovIndex, 8, 0, result);
+		case 't': return query_range(term + 1, TechIndex, NUM_TECH_LEVELS, 1, result);
+		case 'p': return query_range(term + 1, PopIndex, NUM_POP_BANDS, 0, result);
+		default: return false;
+	}
+}
+
+/* ========================================== *
+ * Worker pool with work-stealing index ranges *
+ * ========================================== */
+
+/*
+ * Each worker owns a run of the job's indices packed as begin << 32 | end,
+ * so a single compare-and-swap claims work: the owner takes grain-sized
+ * chunks off the front and an idle worker steals the back half.
+ */
+typedef struct {
+	_Atomic uint64_t range;
+	char pad[64 - sizeof(uint64_t)];  /* One cache line per worker */
+} WorkRange;
+
+typedef void (*RangeBody)(void *context, uint32_t worker, uint32_t begin, uint32_t end);
+
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_cond_t done;
+	uint32_t workers;     /* Including the thread calling parallel_for */
+	uint64_t generation;  /* Bumped for every job */
+	uint32_t finished;
+	RangeBody body;
+	void *context;
+	uint32_t grain;
+	WorkRange ranges[MAX_WORKERS];
+} WorkerPool;
+
+WorkerPool Pool = {.lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER, .done = PTHREAD_COND_INITIALIZER};
+uint32_t WorkerCount; /* From --threads; 0 means one per core */
+
+static inline uint64_t pack_range(uint32_t begin, uint32_t end)
+{
+	return (uint64_t)begin << 32 | end;
+}
+
+/* Claim up to a grain of indices from the front of this worker's own range */
+bool take_work(uint32_t worker, uint32_t *begin, uint32_t *end)
+{
+	_Atomic uint64_t *slot = &Pool.ranges[worker].range;
+	uint64_t seen = atomic_load(slot);
+
+	for(;;)
+	{
+		uint32_t b = (uint32_t)(seen >> 32), e = (uint32_t)seen;
+		uint32_t take = e - b < Pool.grain ? e - b : Pool.grain;
+		if(b >= e) return false;
+		if(atomic_compare_exchange_weak(slot, &seen, pack_range(b + take, e)))
+		{
+			*begin = b;
+			*end = b + take;
+			return true;
+		}
+	}
+}
+
+/* Move the back half of some other worker's range into this worker's own */
+bool steal_work(uint32_t worker)
+{
+	for(uint32_t k = 1; k < Pool.workers; k++)
+	{
+		_Atomic uint64_t *slot = &Pool.ranges[(worker + k) % Pool.workers].range;
+		uint64_t seen = atomic_load(slot);
+
+		for(;;)
+		{
+			uint32_t b = (uint32_t)(seen >> 32), e = (uint32_t)seen;
+			uint32_t mid = e - (e - b + 1) / 2;
+			if(b >= e) break;
+			if(atomic_compare_exchange_weak(slot, &seen, pack_range(b, mid)))
+			{
+				/* Only the owner refills an empty range, so a plain store will do */
+				atomic_store(&Pool.ranges[worker].range, pack_range(mid, e));
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void run_ranges(uint32_t worker)
+{
+	uint32_t begin, end;
+	do
+	{
+		while(take_work(worker, &begin, &end))
+			Pool.body(Pool.context, worker, begin, end);
+	} while(steal_work(worker));
+}
+
+void *worker_thread(void *argument)
+{
+	uint32_t worker = (uint32_t)(uintptr_t)argument;
+	uint64_t seen = 0;
+
+	pthread_mutex_lock(&Pool.lock);
+	for(;;)
+	{
+		while(Pool.generation == seen) pthread_cond_wait(&Pool.wake, &Pool.lock);
+		seen = Pool.generation;
+		pthread_mutex_unlock(&Pool.lock);
+
+		run_ranges(worker);
+
+		pthread_mutex_lock(&Pool.lock);
+		if(++Pool.finished == Pool.workers) pthread_cond_signal(&Pool.done);
+	}
+	return NULL;
+}
+
+uint32_t default_worker_count(void)
+{
+#ifdef _WIN32
+	const char *cores = getenv("NUMBER_OF_PROCESSORS");
+	long n = cores != NULL ? strtol(cores, NULL, 10) : 1;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	return n < 1 ? 1 : n > MAX_WORKERS ? MAX_WORKERS : (uint32_t)n;
+}
+
+/* Threads are started on first use and then wait for each job */
+void start_workers(void)
+{
+	if(Pool.workers != 0) return;
+	Pool.workers = WorkerCount != 0 ? WorkerCount : default_worker_count();
+	for(uint32_t w = 1; w < Pool.workers; w++)
+	{
+		pthread_t thread;
+		if(pthread_create(&thread, NULL, worker_thread, (void *)(uintptr_t)w) != 0)
+			stop("Cannot start worker thread");
+		pthread_detach(thread);
+	}
+}
+
+/*
+ * Call body on every index in [0, count), a grain at a time, across all
+ * workers; the caller works too and returns once every index is done.
+ * Jobs must not nest.
+ */
+void parallel_for(uint32_t count, uint32_t grain, RangeBody body, void *context)
+{
+	start_workers();
+
+	pthread_mutex_lock(&Pool.lock);
+	for(uint32_t w = 0; w < Pool.workers; w++)
+		atomic_store(&Pool.ranges[w].range, pack_range((uint32_t)((uint64_t)count * w / Pool.workers),
+		                                               (uint32_t)((uint64_t)count * (w + 1) / Pool.workers)));
+	Pool.body = body;
+	Pool.context = context;
+	Pool.grain = grain > 0 ? grain : 1;
+	Pool.finished = 0;
+	Pool.generation++;
+	pthread_cond_broadcast(&Pool.wake);
+	pthread_mutex_unlock(&Pool.lock);
+
+	run_ranges(0);
+
+	pthread_mutex_lock(&Pool.lock);
+	Pool.finished++;
+	while(Pool.finished < Pool.workers) pthread_cond_wait(&Pool.done, &Pool.lock);
+	pthread_mutex_unlock(&Pool.lock);
+}
+
+double elapsed_seconds(const struct timespec *since)
+{
+	struct timespec now;
+	timespec_get(&now, TIME_UTC);
+	return (double)(now.tv_sec - since->tv_sec) + (now.tv_nsec - since->tv_nsec) / 1e9;
+}
+
+
+/* ========================================= *
+ * Neighbour cache filled in the background  *
+ * ========================================= */
+
+/*
+ * After a jump the player nearly always looks around: local, info on a
+ * neighbour, fill for one. A background thread works out the distance,
+ * description and baseline market of every system in jump range of the
+ * new position into the spare of two caches, then swaps it in. Commands
+ * read the current cache under the lock and only generate what it does
+ * not cover yet; the thread alone ever writes, and only to the spare.
+ */
+typedef struct {
+	uint16_t galaxyNum;          /* 0 while empty */
+	PlanetNum centre;
+	PlanetNum count, capacity;
+	PlanetNum *near;             /* In index order, the centre included */
+	uint16_t *distance;
+	Description *description;
+	MarketType *baseline;
+} NeighbourCache;
+
+struct {
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	bool started;
+	bool filling;                /* The thread is writing the spare */
+	uint16_t wantGalaxy;         /* Latest request, 0 once taken */
+	PlanetNum wantCentre;
+	uint32_t current;            /* Index of the cache commands read */
+	NeighbourCache cache[2];
+} Neighbours = {.lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER};
+
+/* Generate a system's description from its own goat soup seed */
+void generate_description(const GalaxyColumns *galaxy, PlanetNum planetIndex, Description *out)
+{
+	struct PlanSys planetSystem = get_system(galaxy, planetIndex);
+	struct FastSeedType rndSeed = planetSystem.goatSoupSeed;
+
+	out->length = 0;
+	out->text[0] = '\0';
+	goat_soup("\x8F is \x97.", &planetSystem, &rndSeed, out);
+}
+
+void fill_neighbour_cache(NeighbourCache *cache, uint16_t galaxyNum, PlanetNum centre, PlanetNum *near, uint64_t *marks)
+{
+	const GalaxyColumns *galaxy = &Universe[galaxyNum - 1];
+	PlanetNum count = systems_within(galaxyNum, centre, (uint16_t)MaxFuel, near, marks);
+
+	if(count > cache->capacity)
+	{
+		cache->capacity = count;
+		cache->near = realloc(cache->near, count * sizeof(PlanetNum));
+		cache->distance = realloc(cache->distance, count * sizeof(uint16_t));
+		cache->description = realloc(cache->description, count * sizeof(Description));
+		cache->baseline = realloc(cache->baseline, count * sizeof(MarketType));
+		if(cache->near == NULL || cache->distance == NULL || cache->description == NULL || cache->baseline == NULL)
+			stop("Out of memory");
+	}
+	for(PlanetNum k = 0; k < count; k++)
+	{
+		cache->near[k] = near[k];
+		cache->distance[k] = distance(galaxy->coord[near[k]], galaxy->coord[centre]);
+		generate_description(galaxy, near[k], &cache->description[k]);
+		cache->baseline[k] = generate_market(0, sys_economy(galaxy->attrs[near[k]]));
+	}
+	cache->galaxyNum = galaxyNum;
+	cache->centre = centre;
+	cache->count = count;
+}
+
+void *neighbour_thread(void *unused)
+{
+	PlanetNum *near = malloc(GalaxySize * sizeof(PlanetNum));
+	uint64_t *marks = new_system_marks();
+	(void)unused;
+
+	if(near == NULL) stop("Out of memory");
+	pthread_mutex_lock(&Neighbours.lock);
+	for(;;)
+	{
+		while(Neighbours.wantGalaxy == 0) pthread_cond_wait(&Neighbours.wake, &Neighbours.lock);
+		uint16_t galaxyNum = Neighbours.wantGalaxy;
+		PlanetNum centre = Neighbours.wantCentre;
+		Neighbours.wantGalaxy = 0;
+		Neighbours.filling = true;
+		pthread_mutex_unlock(&Neighbours.lock);
+
+		fill_neighbour_cache(&Neighbours.cache[Neighbours.current ^ 1], galaxyNum, centre, near, marks);
+
+		pthread_mutex_lock(&Neighbours.lock);
+		Neighbours.current ^= 1;
+		Neighbours.filling = false;
+	}
+	return NULL;
+}
+
+/* Ask for the neighbourhood of a system the player has just arrived at */
+void neighbour_request(uint16_t galaxyNum, PlanetNum centre)
+{
+	galaxy_lookup(galaxyNum);  /* Built lazily, so build it here rather than race the thread */
+
+	pthread_mutex_lock(&Neighbours.lock);
+	if(!Neighbours.started)
+	{
+		pthread_t thread;
+		if(pthread_create(&thread, NULL, neighbour_thread, NULL) != 0) stop("Cannot start neighbour thread");
+		pthread_detach(thread);
+		Neighbours.started = true;
+	}
+	Neighbours.wantGalaxy = galaxyNum;
+	Neighbours.wantCentre = centre;
+	pthread_cond_signal(&Neighbours.wake);
+	pthread_mutex_unlock(&Neighbours.lock);
+}
+
+/* Free both caches unless the thread is busy with one; true if they were freed */
+bool neighbour_release(void)
+{
+	bool idle;
+
+	pthread_mutex_lock(&Neighbours.lock);
+	idle = !Neighbours.filling && Neighbours.wantGalaxy == 0;
+	for(uint32_t c = 0; idle && c < 2; c++)
+	{
+		NeighbourCache *cache = &Neighbours.cache[c];
+		free(cache->near);
+		free(cache->distance);
+		free(cache->description);
+		free(cache->baseline);
+		*cache = (NeighbourCache){0};
+	}
+	pthread_mutex_unlock(&Neighbours.lock);
+	return idle;
+}
+
+/* Position of a system in the current cache, or -1; call with the lock held */
+PlanetNum neighbour_slot(uint16_t galaxyNum, PlanetNum planetIndex)
+{
+	const NeighbourCache *cache = &Neighbours.cache[Neighbours.current];
+	PlanetNum low = 0, high = cache->count;
+
+	if(cache->galaxyNum != galaxyNum) return -1;
+	while(low < high)
+	{
+		PlanetNum mid = (low + high) / 2;
+		if(cache->near[mid] < planetIndex) low = mid + 1;
+		else high = mid;
+	}
+	return low < cache->count && cache->near[low] == planetIndex ? low : -1;
+}
+
+/* Systems within MaxFuel of centre and their distances, from the cache if it is centred there */
+PlanetNum neighbours_of(uint16_t galaxyNum, PlanetNum centre, PlanetNum *near, uint16_t *distances)
+{
+	const GalaxyColumns *galaxy = &Universe[galaxyNum - 1];
+	const NeighbourCache *cache;
+	PlanetNum count = -1;
+
+	pthread_mutex_lock(&Neighbours.lock);
+	cache = &Neighbours.cache[Neighbours.current];
+	if(cache->galaxyNum == galaxyNum && cache->centre == centre)
+	{
+		count = cache->count;
+		memcpy(near, cache->near, count * sizeof(PlanetNum));
+		memcpy(distances, cache->distance, count * sizeof(uint16_t));
+	}
+	pthread_mutex_unlock(&Neighbours.lock);
+	if(count >= 0) return count;
+
+	uint64_t *marks = new_system_marks();
+	count = systems_within(galaxyNum, centre, (uint16_t)MaxFuel, near, marks);
+	for(PlanetNum k = 0; k < count; k++) distances[k] = distance(galaxy->coord[near[k]], galaxy->coord[centre]);
+	free(marks);
+	return count;
+}
+
+void system_description(const GalaxyColumns *galaxy, PlanetNum planetIndex, Description *out)
+{
+	uint16_t galaxyNum = (uint16_t)(galaxy - Universe + 1);
+	PlanetNum slot;
+
+	pthread_mutex_lock(&Neighbours.lock);
+	slot = neighbour_slot(galaxyNum, planetIndex);
+	if(slot >= 0) *out = Neighbours.cache[Neighbours.current].description[slot];
+	pthread_mutex_unlock(&Neighbours.lock);
+	if(slot < 0) generate_description(galaxy, planetIndex, out);
+}
+
+/* A system's market before any fluctuation, from the cache when it is nearby */
+MarketType baseline_market(uint16_t galaxyNum, PlanetNum planetIndex)
+{
+	MarketType market;
+	PlanetNum slot;
+
+	pthread_mutex_lock(&Neighbours.lock);
+	slot = neighbour_slot(galaxyNum, planetIndex);
+	if(slot >= 0) market = Neighbours.cache[Neighbours.current].baseline[slot];
+	pthread_mutex_unlock(&Neighbours.lock);
+	if(slot < 0) market = generate_market(0, sys_economy(Universe[galaxyNum - 1].attrs[planetIndex]));
+	return market;
+}
+
+/* ====================================== *
+ * Monte Carlo simulation of commanders   *
+ * ====================================== */
+
+#define SIM_START_CASH (1000) /* 100 CR, as a new game */
+#define SIM_HOLD (20)
+#define SIM_SEED (12345)
+
+/* A simulated commander: the game's workspace plus a private random stream */
+typedef struct {
+	Commander cmdr;
+	unsigned int randState;
+	uint32_t jumps;
+	const JumpGraph *graph;
+} SimCommander;
+
+/* The game primitives a strategy plays with */
+uint16_t sim_buy(SimCommander *sim, uint16_t itemIndex, uint16_t amount)
+{
+	return execute_buy_order(&sim->cmdr, itemIndex, amount);
+}
+
+void sim_sell_all(SimCommander *sim)
+{
+	for(uint16_t i = 0; i <= LAST_TRADE; i++)
+		execute_sell_order(&sim->cmdr, i, sim->cmdr.shipHold[i]);
+}
+
+void sim_refuel(SimCommander *sim)
+{
+	calculate_fuel_purchase(&sim->cmdr, (uint16_t)MaxFuel);
+}
+
+bool sim_jump(SimCommander *sim, PlanetNum dest)
+{
+	const GalaxyColumns *galaxy = &Universe[sim->cmdr.galaxyNum - 1];
+	uint16_t d = distance(galaxy->coord[dest], galaxy->coord[sim->cmdr.currentPlanet]);
+
+	if(dest == sim->cmdr.currentPlanet || d > sim->cmdr.fuel) return false;
+	sim->cmdr.fuel -= d;
+	execute_jump_to_planet(&sim->cmdr, dest, (uint16_t)(lcg_next(&sim->randState) & 0xFF));
+	sim->jumps++;
+	return true;
+}
+
+/* Number of neighbours the fuel left reaches; with edge set, the one picked by index */
+uint32_t sim_reachable(const SimCommander *sim, uint32_t pick, uint32_t *edge)
+{
+	const JumpGraph *graph = sim->graph;
+	PlanetNum at = sim->cmdr.currentPlanet;
+	uint32_t count = 0;
+
+	for(uint32_t e = graph->offset[at]; e < graph->offset[at + 1]; e++)
+	{
+		if(graph->hopDistance[e] > sim->cmdr.fuel) continue;
+		if(edge != NULL && count == pick) *edge = e;
+		count++;
+	}
+	return count;
+}
+
+/*
+ * Strategies each play one turn at the current system: cargo has already
+ * been sold and the tank refilled, so they buy and jump. They return false
+ * when the commander is stranded.
+ */
+bool strategy_random(SimCommander *sim)
+{
+	uint32_t count = sim_reachable(sim, 0, NULL), edge;
+
+	if(count == 0) return false;
+	sim_buy(sim, (uint16_t)(lcg_next(&sim->randState) % ALIEN_ITEMS), UINT16_MAX);
+	sim_reachable(sim, (uint32_t)lcg_next(&sim->randState) % count, &edge);
+	return sim_jump(sim, sim->graph->neighbour[edge]);
+}
+
+/* Food bought on agricultural worlds and sold on industrial ones, nearest first */
+bool strategy_food(SimCommander *sim)
+{
+	const JumpGraph *graph = sim->graph;
+	const GalaxyColumns *galaxy = &Universe[sim->cmdr.galaxyNum - 1];
+	PlanetNum at = sim->cmdr.currentPlanet, best = at;
+	bool agricultural = sys_economy(galaxy->attrs[at]) >= 4;
+	int bestScore = INT32_MAX;
+
+	/* From a farm world head for the most industrial neighbour, else back to the most agricultural */
+	for(uint32_t e = graph->offset[at]; e < graph->offset[at + 1]; e++)
+	{
+		uint16_t economy = sys_economy(galaxy->attrs[graph->neighbour[e]]);
+		int score = (agricultural ? economy : 7 - economy) * 256 + graph->hopDistance[e];
+		if(graph->hopDistance[e] > sim->cmdr.fuel) continue;
+		if(score < bestScore)
+		{
+			best = graph->neighbour[e];
+			bestScore = score;
+		}
+	}
+	if(best == at) return false;
+	if(agricultural) sim_buy(sim, 0, UINT16_MAX);
+	return sim_jump(sim, best);
+}
+
+/* Whatever good and neighbour promise the most profit at baseline prices there */
+bool strategy_greedy(SimCommander *sim)
+{
+	const JumpGraph *graph = sim->graph;
+	const GalaxyColumns *galaxy = &Universe[sim->cmdr.galaxyNum - 1];
+	PlanetNum at = sim->cmdr.currentPlanet;
+	uint32_t count = sim_reachable(sim, 0, NULL), edge;
+	int32_t units[LAST_TRADE + 1];
+	int32_t bestProfit = 0;
+	uint16_t bestItem = 0;
+	PlanetNum bestDest = at;
+
+	if(count == 0) return false;
+	affordable_units(&sim->cmdr.localMarket, sim->cmdr.cash, sim->cmdr.holdSpace, units);
+	for(uint32_t e = graph->offset[at]; e < graph->offset[at + 1]; e++)
+	{
+		MarketType there;
+		uint16_t item = 0;
+		int32_t profit;
+		if(graph->hopDistance[e] > sim->cmdr.fuel) continue;
+		there = generate_market(0, sys_economy(galaxy->attrs[graph->neighbour[e]]));
+		profit = best_trade(&sim->cmdr.localMarket, &there, units, &item);
+		if(profit > bestProfit)
+		{
+			bestProfit = profit;
+			bestItem = item;
+			bestDest = graph->neighbour[e];
+		}
+	}
+
+	if(bestDest != at)
+	{
+		sim_buy(sim, bestItem, UINT16_MAX);
+		return sim_jump(sim, bestDest);
+	}
+	/* Nothing pays: move on empty */
+	sim_reachable(sim, (uint32_t)lcg_next(&sim->randState) % count, &edge);
+	return sim_jump(sim, graph->neighbour[edge]);
+}
+
+char strategies[NUM_STRATEGIES][MAX_LEN] = {"random", "food", "greedy"};
+
+bool (*stratfuncs[NUM_STRATEGIES])(SimCommander *) =
+{
+	strategy_random, strategy_food, strategy_greedy
+};
+
+typedef struct {
+	bool (*turn)(SimCommander *);
+	const JumpGraph *graph;
+	uint32_t jumpsEach;
+	Money *finalCash;
+	float *profitPerJump;
+	_Atomic uint64_t jumpsMade;
+} SimJob;
+
+/* Spread commander numbers over the generator's seed space */
+unsigned int sim_seed(uint32_t commander)
+{
+	uint64_t z = SIM_SEED + (uint64_t)commander * 0x9E3779B97F4A7C15;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+	return (unsigned int)(z ^ (z >> 31));
+}
+
+void simulate_commanders(void *context, uint32_t worker, uint32_t begin, uint32_t end)
+{
+	SimJob *job = context;
+	uint64_t jumps = 0;
+	(void)worker;
+
+	for(uint32_t n = begin; n < end; n++)
+	{
+		SimCommander sim;
+		memset(&sim, 0, sizeof(sim));
+		sim.cmdr.galaxyNum = 1;
+		sim.cmdr.cash = SIM_START_CASH;
+		sim.cmdr.holdSpace = SIM_HOLD;
+		sim.cmdr.fuel = (uint16_t)MaxFuel;
+		sim.randState = sim_seed(n);
+		sim.graph = job->graph;
+		execute_jump_to_planet(&sim.cmdr, NUM_FOR_LAVE, 0);
+
+		while(sim.jumps < job->jumpsEach)
+		{
+			sim_sell_all(&sim);
+			sim_refuel(&sim);
+			if(!job->turn(&sim)) break;
+		}
+		sim_sell_all(&sim);
+
+		job->finalCash[n] = sim.cmdr.cash;
+		job->profitPerJump[n] = sim.jumps > 0 ? (float)(sim.cmdr.cash - SIM_START_CASH) / sim.jumps : 0;
+		jumps += sim.jumps;
+	}
+	atomic_fetch_add(&job->jumpsMade, jumps);
+}
+
+int compare_money(const void *a, const void *b)
+{
+	Money x = *(const Money *)a, y = *(const Money *)b;
+	return (x > y) - (x < y);
+}
+
+int compare_float(const void *a, const void *b)
+{
+	float x = *(const float *)a, y = *(const float *)b;
+	return (x > y) - (x < y);
+}
+
+/* Index of the d'th decile in n sorted values */
+uint32_t decile(uint32_t n, uint32_t d)
+{
+	return (uint32_t)((uint64_t)(n - 1) * d / 10);
+}
+
+
+/* ========================================== *
+ * NPC traders on persistent shared markets   *
+ * ========================================== */
+
+#define NPC_START_CASH (10000)
+#define NPC_HOLD (20)
+#define NPC_SEED (54321)
+
+#define NPC_NO_ITEM (UINT16_MAX)
+
+/* Stock of every good at one system */
+typedef struct {
+	uint16_t quantity[LAST_TRADE + 1];
+} SharedMarket;
+
+typedef struct {
+	PlanetNum at;
+	PlanetNum dest;     /* Where the trader goes this tick */
+	uint16_t item;      /* Cargo carried to sell here */
+	uint16_t carried;
+	uint16_t buy;       /* Good to buy here for dest, or NPC_NO_ITEM */
+	Money cash;
+	unsigned int randState;
+} NpcTrader;
+
+/* Trades per worker, a cache line apiece */
+typedef struct {
+	uint64_t trades;
+	char pad[64 - sizeof(uint64_t)];
+} WorkerCounter;
+
+/*
+ * The traders' galaxy persists between npc commands: stock they buy stays
+ * gone until the market restocks, one unit per good per tick, towards the
+ * fluctuation-0 baseline of the system's economy. Unless markets are fresh
+ * the stock is loaded from the player's market deltas before a run and
+ * written back after it, so both trade in the same markets.
+ *
+ * A tick runs in two passes so that it comes out the same on any number of
+ * threads. Traders first choose where to go and what to buy while markets
+ * are only read; then each market settles the traders docked at it, sales
+ * before purchases in trader order, from a list bucketed by system.
+ */
+struct {
+	uint16_t galaxyNum;             /* 0 until the first npc command */
+	uint32_t agents;
+	uint64_t ticks;
+	uint64_t runs;                  /* Changes to the world, so digests can cache its hash */
+	NpcTrader *trader;
+	SharedMarket *market;
+	uint32_t *docked;               /* Trader indices grouped by system, in order */
+	uint32_t *firstDocked;          /* Per system, GalaxySize + 1 entries */
+	MarketType baseline[8];         /* By economy */
+	WorkerCounter counter[MAX_WORKERS];
+} NpcWorld;
+
+/* Start the traders' markets over in the player's galaxy, with no traders yet */
+void npc_reset(void)
+{
+	const GalaxyColumns *galaxy = &Universe[Player.galaxyNum - 1];
+
+	free(NpcWorld.trader);
+	free(NpcWorld.docked);
+	NpcWorld.trader = NULL;
+	NpcWorld.docked = NULL;
+	NpcWorld.agents = 0;
+	NpcWorld.galaxyNum = Player.galaxyNum;
+	NpcWorld.ticks = 0;
+	NpcWorld.runs++;
+	if(NpcWorld.market == NULL) NpcWorld.market = malloc(GalaxySize * sizeof(SharedMarket));
+	if(NpcWorld.firstDocked == NULL) NpcWorld.firstDocked = malloc((GalaxySize + 1) * sizeof(uint32_t));
+	if(NpcWorld.market == NULL || NpcWorld.firstDocked == NULL) stop("Out of memory");
+
+	for(uint16_t economy = 0; economy < 8; economy++)
+		NpcWorld.baseline[economy] = generate_market(0, economy);
+	for(PlanetNum i = 0; i < GalaxySize; i++)
+	{
+		const MarketType *baseline = &NpcWorld.baseline[sys_economy(galaxy->attrs[i])];
+		memcpy(NpcWorld.market[i].quantity, baseline->quantity, sizeof(NpcWorld.market[i].quantity));
+	}
+}
+
+/* Grow or shrink the traders to agents; those already trading carry on */
+void npc_hire(uint32_t agents)
+{
+	NpcTrader *trader = realloc(NpcWorld.trader, agents * sizeof(NpcTrader));
+	uint32_t *docked = realloc(NpcWorld.docked, agents * sizeof(uint32_t));
+
+	if(trader == NULL || docked == NULL) stop("Out of memory");
+	for(uint32_t n = NpcWorld.agents; n < agents; n++)
+	{
+		trader[n].randState = sim_seed(n) ^ NPC_SEED;
+		trader[n].at = (PlanetNum)((uint32_t)lcg_next(&trader[n].randState) % (uint32_t)GalaxySize);
+		trader[n].item = 0;
+		trader[n].carried = 0;
+		trader[n].cash = NPC_START_CASH;
+	}
+	NpcWorld.trader = trader;
+	NpcWorld.docked = docked;
+	NpcWorld.agents = agents;
+	NpcWorld.runs++;
+}
+
+/* First pass of a tick for a batch of traders: pick a random neighbour and the good that pays best there */
+void npc_choose(void *context, uint32_t worker, uint32_t begin, uint32_t end)
+{
+	const JumpGraph *graph = context;
+	const GalaxyColumns *galaxy = &Universe[NpcWorld.galaxyNum - 1];
+	(void)worker;
+
+	for(uint32_t n = begin; n < end; n++)
+	{
+		NpcTrader *trader = &NpcWorld.trader[n];
+		const SharedMarket *market = &NpcWorld.market[trader->at];
+		const MarketType *here = &NpcWorld.baseline[sys_economy(galaxy->attrs[trader->at])];
+		uint32_t degree = graph->offset[trader->at + 1] - graph->offset[trader->at];
+		const MarketType *there;
+		int32_t bestMargin = 0;
+
+		trader->dest = trader->at;
+		trader->buy = NPC_NO_ITEM;
+		if(degree == 0) continue;
+
+		trader->dest = graph->neighbour[graph->offset[trader->at] + (uint32_t)lcg_next(&trader->randState) % degree];
+		there = &NpcWorld.baseline[sys_economy(galaxy->attrs[trader->dest])];
+		for(uint16_t i = 0; i < ALIEN_ITEMS; i++)
+		{
+			if(there->price[i] - here->price[i] > bestMargin && here->price[i] > 0 && market->quantity[i] > 0)
+			{
+				bestMargin = there->price[i] - here->price[i];
+				trader->buy = i;
+			}
+		}
+	}
+}
+
+/* Bucket the traders by system, keeping index order within each */
+void npc_dock(void)
+{
+	uint32_t *first = NpcWorld.firstDocked;
+
+	memset(first, 0, (GalaxySize + 1) * sizeof(uint32_t));
+	for(uint32_t n = 0; n < NpcWorld.agents; n++) first[NpcWorld.trader[n].at + 1]++;
+	for(PlanetNum i = 0; i < GalaxySize; i++) first[i + 1] += first[i];
+	for(uint32_t n = 0; n < NpcWorld.agents; n++) NpcWorld.docked[first[NpcWorld.trader[n].at]++] = n;
+	for(PlanetNum i = GalaxySize; i > 0; i--) first[i] = first[i - 1];
+	first[0] = 0;
+}
+
+/* Second pass for a batch of markets: each docked trader sells its cargo, buys what it chose and moves on */
+void npc_settle(void *context, uint32_t worker, uint32_t begin, uint32_t end)
+{
+	const GalaxyColumns *galaxy = &Universe[NpcWorld.galaxyNum - 1];
+	uint64_t trades = 0;
+	(void)context;
+
+	for(uint32_t i = begin; i < end; i++)
+	{
+		SharedMarket *market = &NpcWorld.market[i];
+		const MarketType *here = &NpcWorld.baseline[sys_economy(galaxy->attrs[i])];
+
+		for(uint32_t d = NpcWorld.firstDocked[i]; d < NpcWorld.firstDocked[i + 1]; d++)
+		{
+			NpcTrader *trader = &NpcWorld.trader[NpcWorld.docked[d]];
+			if(trader->carried > 0)
+			{
+				uint32_t quantity = market->quantity[trader->item] + trader->carried;
+				market->quantity[trader->item] = (uint16_t)(quantity > UINT16_MAX ? UINT16_MAX : quantity);
+				money_add(&trader->cash, money_times(here->price[trader->item], trader->carried));
+				trader->carried = 0;
+				trades++;
+			}
+		}
+		for(uint32_t d = NpcWorld.firstDocked[i]; d < NpcWorld.firstDocked[i + 1]; d++)
+		{
+			NpcTrader *trader = &NpcWorld.trader[NpcWorld.docked[d]];
+			if(trader->buy != NPC_NO_ITEM)
+			{
+				Money afford = trader->cash / here->price[trader->buy];
+				uint16_t want = afford > UINT16_MAX ? UINT16_MAX : (uint16_t)afford;
+				if(Commodities[trader->buy].units == TONNES) want = minimum_value(want, NPC_HOLD);
+				trader->carried = minimum_value(want, market->quantity[trader->buy]);
+				trader->item = trader->buy;
+				market->quantity[trader->buy] -= trader->carried;
+				money_add(&trader->cash, -money_times(here->price[trader->buy], trader->carried));
+				if(trader->carried > 0) trades++;
+			}
+			trader->at = trader->dest;
+		}
+	}
+	NpcWorld.counter[worker].trades += trades;
+}
+
+/* Every market moves one unit per good back towards its baseline stock */
+void npc_restock(void *context, uint32_t worker, uint32_t begin, uint32_t end)
+{
+	const GalaxyColumns *galaxy = &Universe[NpcWorld.galaxyNum - 1];
+	(void)context;
+	(void)worker;
+
+	for(uint32_t i = begin; i < end; i++)
+	{
+		const MarketType *baseline = &NpcWorld.baseline[sys_economy(galaxy->attrs[i])];
+		for(uint16_t k = 0; k <= LAST_TRADE; k++)
+		{
+			uint16_t q = NpcWorld.market[i].quantity[k];
+			if(q != baseline->quantity[k]) NpcWorld.market[i].quantity[k] = q < baseline->quantity[k] ? q + 1 : q - 1;
+		}
+	}
+}
+
+/* ============================================= *
+ * Economy clock: markets drifting around baseline *
+ * ============================================= */
+
+#define ECONOMY_HORIZON (512)    /* Ticks a lazy catch-up replays at most */
+#define ECONOMY_DRIFT_LIMIT (32 << 8)
+#define ECONOMY_NOISE_SPAN (1 << 16)
+
+/*
+ * Each market carries a drift per good in 1/256ths of a price step (4
+ * tenths of a CR) that follows a mean-reverting random walk: every tick it
+ * loses reversion/256 of itself and gains up to +/-volatility/256 of noise.
+ * Prices and stock move together by the whole steps, as with the
+ * fluctuation byte. Each tick reads its noise from a fixed table at an
+ * offset hashed from the tick, so a galaxy nobody is in can be left alone
+ * and caught up when it is next looked at.
+ */
+uint64_t EconomyTick;              /* 0 while the clock has never run */
+int32_t EconomyReversion = 16;     /* Per tick, in 1/256ths */
+int32_t EconomyVolatility = 192;
+int16_t *EconomyDrift;             /* [galaxy][good][system] */
+uint64_t *EconomyGalaxyTick;       /* Tick each galaxy's drift is current to */
+int16_t *EconomyNoise;             /* ECONOMY_NOISE_SPAN + one galaxy's worth */
+
+static inline int16_t *economy_drift(uint16_t galaxyNumber, uint16_t itemIndex)
+{
+	return EconomyDrift + ((size_t)(galaxyNumber - 1) * (LAST_TRADE + 1) + itemIndex) * GalaxySize;
+}
+
+/* One tick for a galaxy: a flat loop over goods x systems that compilers vectorise */
+void economy_step(uint16_t galaxyNumber, uint64_t tick)
+{
+	int16_t *restrict drift = economy_drift(galaxyNumber, 0);
+	uint64_t offset = ((tick ^ (uint64_t)galaxyNumber << 48) * 0x9E3779B97F4A7C15) >> 48;
+	const int16_t *restrict noise = EconomyNoise + offset;
+	uint32_t count = (uint32_t)(LAST_TRADE + 1) * (uint32_t)GalaxySize;
+	int32_t reversion = EconomyReversion;
+
+	for(uint32_t i = 0; i < count; i++)
+	{
+		int32_t d = drift[i] - (drift[i] * reversion >> 8) + noise[i];
+		d = d > ECONOMY_DRIFT_LIMIT ? ECONOMY_DRIFT_LIMIT : d < -ECONOMY_DRIFT_LIMIT ? -ECONOMY_DRIFT_LIMIT : d;
+		drift[i] = (int16_t)d;
+	}
+}
+
+/* Bring a galaxy up to the clock, replaying at most ECONOMY_HORIZON ticks */
+void economy_catch_up(uint16_t galaxyNumber)
+{
+	uint64_t from = EconomyGalaxyTick[galaxyNumber - 1];
+
+	if(EconomyTick - from > ECONOMY_HORIZON)
+	{
+		/* Older drift has all but decayed; start afresh */
+		memset(economy_drift(galaxyNumber, 0), 0, (LAST_TRADE + 1) * GalaxySize * sizeof(int16_t));
+		from = EconomyTick - ECONOMY_HORIZON;
+	}
+	while(from < EconomyTick) economy_step(galaxyNumber, ++from);
+	EconomyGalaxyTick[galaxyNumber - 1] = EconomyTick;
+}
+
+void economy_start(void)
+{
+	size_t perGalaxy = (size_t)(LAST_TRADE + 1) * GalaxySize;
+	unsigned int noiseSeed = SIM_SEED;
+
+	if(EconomyDrift != NULL) return;
+	EconomyDrift = calloc(GalaxyCount * perGalaxy, sizeof(int16_t));
+	EconomyGalaxyTick = calloc(GalaxyCount, sizeof(uint64_t));
+	EconomyNoise = malloc((ECONOMY_NOISE_SPAN + perGalaxy) * sizeof(int16_t));
+	if(EconomyDrift == NULL || EconomyGalaxyTick == NULL || EconomyNoise == NULL) stop("Out of memory");
+
+	for(size_t i = 0; i < ECONOMY_NOISE_SPAN + perGalaxy; i++)
+		EconomyNoise[i] = (int16_t)((((lcg_next(&noiseSeed) >> 8) & 0x1FF) - 256) * EconomyVolatility >> 8);
+}
+
+/* Rebuild a commander's market from its arrival fluctuation plus the drift now */
+void economy_market(Commander *cmdr)
+{
+	PlanetNum at = cmdr->currentPlanet;
+	MarketType *market = &cmdr->localMarket;
+
+	economy_catch_up(cmdr->galaxyNum);
+	*market = generate_market(cmdr->fluctuation, sys_economy(Universe[cmdr->galaxyNum - 1].attrs[at]));
+	for(uint16_t i = 0; i < ALIEN_ITEMS; i++)
+	{
+		int32_t shift = economy_drift(cmdr->galaxyNum, i)[at] >> 8;
+		int32_t price = market->price[i] / 4 + shift, quantity = market->quantity[i] + shift;
+		market->price[i] = (uint16_t)((price < 0 ? 0 : price > 255 ? 255 : price) * 4);
+		market->quantity[i] = (uint16_t)(quantity < 0 ? 0 : quantity > 63 ? 63 : quantity);
+	}
+}
+
+/* ========================================== *
+ * Player changes to markets, kept per system *
+ * ========================================== */
+
+#define MARKET_DELTA_LIMIT (127)
+
+/*
+ * Stock the player buys or sells is remembered as an offset from the
+ * generated market, so a system bought out stays bought out on the next
+ * visit. Only systems traded at take a record: each galaxy's slot table,
+ * allocated on first use, holds one plus the index of the system's row in
+ * a shared pool of deltas, or 0. Offsets saturate at +/-127 units.
+ * MarketDeltaHash sums a hash of every nonzero offset with its system and
+ * good, kept up to date as offsets change, so digests cover remote markets.
+ */
+typedef int8_t MarketDelta[LAST_TRADE + 1];
+
+bool PersistentMarkets = true;       /* Cleared by --fresh-markets */
+uint32_t *MarketSlots[MAX_GALAXIES]; /* Per galaxy, GalaxySize entries */
+MarketDelta *MarketDeltas;
+uint32_t MarketDeltaCount, MarketDeltaCapacity;
+uint64_t MarketDeltaHash;
+
+static inline uint64_t market_delta_term(uint16_t galaxyNumber, PlanetNum planetIndex, uint16_t itemIndex, int8_t delta)
+{
+	uint64_t key = (uint64_t)galaxyNumber << 48 | (uint64_t)(uint32_t)planetIndex << 16 | (uint64_t)itemIndex << 8 | (uint8_t)delta;
+
+	if(delta == 0) return 0;
+	key = (key ^ key >> 31) * 0xBF58476D1CE4E5B9;
+	key = (key ^ key >> 27) * 0x94D049BB133111EB;
+	return key ^ key >> 31;
+}
+
+/* Change one offset, keeping MarketDeltaHash in step */
+void market_delta_set(MarketDelta *row, uint16_t galaxyNumber, PlanetNum planetIndex, uint16_t itemIndex, int8_t delta)
+{
+	MarketDeltaHash += market_delta_term(galaxyNumber, planetIndex, itemIndex, delta) -
+	                   market_delta_term(galaxyNumber, planetIndex, itemIndex, (*row)[itemIndex]);
+	(*row)[itemIndex] = delta;
+}
+
+/* The system's row of deltas, or NULL if the player has never traded there */
+MarketDelta *market_deltas(uint16_t galaxyNumber, PlanetNum planetIndex, bool create)
+{
+	uint32_t **slots = &MarketSlots[galaxyNumber - 1];
+
+	if(*slots == NULL)
+	{
+		if(!create) return NULL;
+		*slots = calloc(GalaxySize, sizeof(uint32_t));
+		if(*slots == NULL) stop("Out of memory");
+	}
+	if((*slots)[planetIndex] == 0)
+	{
+		if(!create) return NULL;
+		if(MarketDeltaCount == MarketDeltaCapacity)
+		{
+			MarketDeltaCapacity = MarketDeltaCapacity ? 2 * MarketDeltaCapacity : 64;
+			MarketDeltas = realloc(MarketDeltas, MarketDeltaCapacity * sizeof(MarketDelta));
+			if(MarketDeltas == NULL) stop("Out of memory");
+		}
+		memset(MarketDeltas[MarketDeltaCount], 0, sizeof(MarketDelta));
+		(*slots)[planetIndex] = ++MarketDeltaCount;
+	}
+	return &MarketDeltas[(*slots)[planetIndex] - 1];
+}
+
+/* Note units the commander took from (negative) or added to the local market */
+void market_record_trade(const Commander *cmdr, uint16_t itemIndex, int32_t change)
+{
+	if(!PersistentMarkets || change == 0) return;
+	MarketDelta *row = market_deltas(cmdr->galaxyNum, cmdr->currentPlanet, true);
+	int32_t d = (*row)[itemIndex] + change;
+	market_delta_set(row, cmdr->galaxyNum, cmdr->currentPlanet, itemIndex,
+	                 (int8_t)(d > MARKET_DELTA_LIMIT ? MARKET_DELTA_LIMIT : d < -MARKET_DELTA_LIMIT ? -MARKET_DELTA_LIMIT : d));
+}
+
+/* Apply past trades to a freshly generated local market */
+void market_restore(Commander *cmdr)
+{
+	const MarketDelta *delta = PersistentMarkets ? market_deltas(cmdr->galaxyNum, cmdr->currentPlanet, false) : NULL;
+
+	if(delta == NULL) return;
+	for(uint16_t i = 0; i <= LAST_TRADE; i++)
+	{
+		int32_t quantity = cmdr->localMarket.quantity[i] + (*delta)[i];
+		cmdr->localMarket.quantity[i] = (uint16_t)(quantity < 0 ? 0 : quantity);
+	}
+}
+
+/* Set the NPC markets to the generated baselines plus the player's deltas */
+void npc_load_markets(void)
+{
+	const GalaxyColumns *galaxy = &Universe[NpcWorld.galaxyNum - 1];
+
+	if(!PersistentMarkets) return;
+	for(PlanetNum i = 0; i < GalaxySize; i++)
+	{
+		const MarketDelta *delta = market_deltas(NpcWorld.galaxyNum, i, false);
+		const MarketType *baseline = &NpcWorld.baseline[sys_economy(galaxy->attrs[i])];
+		for(uint16_t k = 0; k <= LAST_TRADE; k++)
+		{
+			int32_t quantity = baseline->quantity[k] + (delta != NULL ? (*delta)[k] : 0);
+			NpcWorld.market[i].quantity[k] = (uint16_t)(quantity < 0 ? 0 : quantity);
+		}
+	}
+}
+
+/* Write the NPC markets back as deltas, and into the player's market if docked there */
+void npc_store_markets(void)
+{
+	const GalaxyColumns *galaxy = &Universe[NpcWorld.galaxyNum - 1];
+
+	if(!PersistentMarkets) return;
+	for(PlanetNum i = 0; i < GalaxySize; i++)
+	{
+		MarketDelta *delta = market_deltas(NpcWorld.galaxyNum, i, false);
+		const MarketType *baseline = &NpcWorld.baseline[sys_economy(galaxy->attrs[i])];
+		bool here = NpcWorld.galaxyNum == Player.galaxyNum && i == Player.currentPlanet;
+		for(uint16_t k = 0; k <= LAST_TRADE; k++)
+		{
+			int32_t d = NpcWorld.market[i].quantity[k] - baseline->quantity[k];
+			int8_t was = delta != NULL ? (*delta)[k] : 0;
+			int8_t now = (int8_t)(d > MARKET_DELTA_LIMIT ? MARKET_DELTA_LIMIT : d < -MARKET_DELTA_LIMIT ? -MARKET_DELTA_LIMIT : d);
+			if(now == was) continue;
+			if(delta == NULL) delta = market_deltas(NpcWorld.galaxyNum, i, true);
+			market_delta_set(delta, NpcWorld.galaxyNum, i, k, now);
+			if(here)
+			{
+				int32_t quantity = Player.localMarket.quantity[k] + now - was;
+				Player.localMarket.quantity[k] = (uint16_t)(quantity < 0 ? 0 : quantity);
+			}
+		}
+	}
+}
+
+/* ========================= *
+ * Arbitrage between systems *
+ * ========================= */
+
+#define ARBITRAGE_TOP (5)
+
+/*
+ * Baseline markets depend on nothing but economy, so the best cargo
+ * between two systems comes from an 8x8 table of economy pairs worked out
+ * for the current cash and hold. Every jump-graph edge then looks its pair
+ * up, with the sources split across the worker pool.
+ */
+typedef struct {
+	const JumpGraph *graph;
+	const GalaxyColumns *galaxy;
+	uint16_t pairItem[8][8];
+	int32_t pairProfit[8][8];
+	int32_t pairUnits[8][8];
+	uint16_t *edgeItem;        /* Per jump-graph edge */
+	int32_t *edgeProfit;
+} ArbitrageJob;
+
+void arbitrage_rows(void *context, uint32_t worker, uint32_t begin, uint32_t end)
+{
+	ArbitrageJob *job = context;
+	const JumpGraph *graph = job->graph;
+	(void)worker;
+
+	for(PlanetNum from = (PlanetNum)begin; from < (PlanetNum)end; from++)
+	{
+		uint16_t source = sys_economy(job->galaxy->attrs[from]);
+		for(uint32_t e = graph->offset[from]; e < graph->offset[from + 1]; e++)
+		{
+			uint16_t dest = sys_economy(job->galaxy->attrs[graph->neighbour[e]]);
+			job->edgeItem[e] = job->pairItem[source][dest];
+			job->edgeProfit[e] = job->pairProfit[source][dest];
+		}
+	}
+}
+
+void print_arbitrage(const ArbitrageJob *job, PlanetNum from, uint32_t e)
+{
+	char name[NAME_WIDTH + 1], profit[MONEY_WIDTH];
+	uint16_t item = job->edgeItem[e];
+	uint16_t source = sys_economy(job->galaxy->attrs[from]);
+	uint16_t dest = sys_economy(job->galaxy->attrs[job->graph->neighbour[e]]);
+	int32_t units = job->pairUnits[source][dest];
+	uint16_t hop = job->graph->hopDistance[e] > 0 ? job->graph->hopDistance[e] : 1;
+
+	get_system_name(job->galaxy, from, name);
+	printf("\n   %8s -> ", name);
+	get_system_name(job->galaxy, job->graph->neighbour[e], name);
+	printf("%-8s %.12s %3i%-2s %7s CR  %5.1f CR/%s  %6.1f CR/LY", name, Commodities[item].name, units,
+	       UnitNames[Commodities[item].units], format_tenths(job->edgeProfit[e], profit),
+	       (float)job->edgeProfit[e] / units / 10, UnitNames[Commodities[item].units],
+	       (float)job->edgeProfit[e] / hop);
+}
+
+/* ============================== *
+ * Multi-leg itinerary planning   *
+ * ============================== */
+
+#define PLAN_BEAM (512)
+#define PLAN_MAX_LEGS (64)
+#define PLAN_MAX_CASH (INT32_MAX / 4)  /* Plans count in 32 bits; richer commanders plan from here */
+
+/*
+ * An itinerary sells everything at each stop, refills the tank and buys
+ * the best cargo for the next leg. More cash never hurts later legs, so
+ * only the richest way of reaching each system after k legs is kept; that
+ * is exact while a layer fits in the beam, and a beam search beyond it.
+ */
+typedef struct {
+	PlanetNum system;
+	int32_t cash;       /* After selling and refuelling here */
+	uint16_t fuel;      /* Tank on leaving */
+	uint32_t parent;    /* Index in the previous layer */
+} PlanNode;
+
+typedef struct {
+	const JumpGraph *graph;
+	const GalaxyColumns *galaxy;
+	const MarketType *baseline;     /* By economy */
+	const MarketType *firstMarket;  /* The market actually here, for leg one */
+	const PlanNode *layer;
+	_Atomic uint64_t *best;         /* Per system: cash + 1 << 32 | node, the richest arrival */
+	uint16_t holdSpace;
+} PlanJob;
+
+/* Best cargo from a node to each economy, as baseline markets depend on nothing else */
+void plan_gains(const PlanJob *job, const PlanNode *node, bool first, int32_t *gain, uint16_t *item, int32_t *units)
+{
+	const MarketType *here = first ? job->firstMarket : &job->baseline[sys_economy(job->galaxy->attrs[node->system])];
+	int32_t affordable[LAST_TRADE + 1];
+
+	affordable_units(here, node->cash, job->holdSpace, affordable);
+	for(uint16_t economy = 0; economy < 8; economy++)
+	{
+		item[economy] = 0;
+		gain[economy] = best_trade(here, &job->baseline[economy], affordable, &item[economy]);
+		units[economy] = affordable[item[economy]];
+	}
+}
+
+/* Cash and cargo for one leg from a node; false if it cannot be flown */
+bool plan_leg(const PlanJob *job, const PlanNode *node, uint32_t e, bool first, int32_t *cash, uint16_t *item, int32_t *units)
+{
+	const JumpGraph *graph = job->graph;
+	uint16_t dest = sys_economy(job->galaxy->attrs[graph->neighbour[e]]);
+	int32_t gain[8], unitsTo[8];
+	uint16_t itemTo[8];
+
+	if(graph->hopDistance[e] > node->fuel) return false;
+	plan_gains(job, node, first, gain, itemTo, unitsTo);
+	*cash = node->cash + gain[dest] - graph->hopDistance[e] * FuelCost;
+	*item = itemTo[dest];
+	*units = unitsTo[dest];
+	return *cash >= 0;
+}
+
+void plan_expand(void *context, uint32_t worker, uint32_t begin, uint32_t end)
+{
+	const PlanJob *job = context;
+	const JumpGraph *graph = job->graph;
+	(void)worker;
+
+	for(uint32_t n = begin; n < end; n++)
+	{
+		const PlanNode *node = &job->layer[n];
+		int32_t gain[8], units[8];
+		uint16_t item[8];
+
+		plan_gains(job, node, node->parent == UINT32_MAX, gain, item, units);
+		for(uint32_t e = graph->offset[node->system]; e < graph->offset[node->system + 1]; e++)
+		{
+			_Atomic uint64_t *slot = &job->best[graph->neighbour[e]];
+			int32_t cash = node->cash + gain[sys_economy(job->galaxy->attrs[graph->neighbour[e]])] - graph->hopDistance[e] * FuelCost;
+			uint64_t packed, seen;
+
+			if(graph->hopDistance[e] > node->fuel || cash < 0) continue;
+			packed = (uint64_t)((uint32_t)cash + 1) << 32 | n;  /* 0 means no arrival yet */
+			seen = atomic_load_explicit(slot, memory_order_relaxed);
+			while(packed > seen &&
+			      !atomic_compare_exchange_weak_explicit(slot, &seen, packed, memory_order_relaxed, memory_order_relaxed));
+		}
+	}
+}
+
+int compare_plan_nodes(const void *a, const void *b)
+{
+	const PlanNode *x = a, *y = b;
+	if(x->cash != y->cash) return x->cash < y->cash ? 1 : -1;
+	return (x->system > y->system) - (x->system < y->system);
+}
+
+/* ======================================= *
+ * Seed-space scanner for universe shapes  *
+ * ======================================= */
+
+#define SCAN_MAX_HITS (64)
+#define SCAN_BATCH (1u << 22)  /* Seeds per parallel_for, so big scans can stop early */
+
+/*
+ * Predicates on galaxy one of a base seed, all of which must hold. Each
+ * needs only a prefix of the galaxy: a name check tweaks straight past the
+ * systems before its index, so most seeds fail without generating any.
+ */
+typedef struct {
+	char name[NAME_WIDTH + 1];  /* Empty if no name=INDEX:NAME */
+	PlanetNum nameIndex;
+	bool anarchyNearTech;       /* anarchy-tl15 */
+	uint32_t dense;             /* dense=N: some system with N neighbours in range, or 0 */
+	PlanetNum systems;          /* Systems the last two need generated */
+} ScanQuery;
+
+/* The earliest matches one worker has found, as offsets from the scan's start, ascending */
+typedef struct {
+	uint64_t offset[SCAN_MAX_HITS];
+	uint32_t count;
+} ScanHits;
+
+typedef struct {
+	const ScanQuery *query;
+	uint64_t first;             /* Seed index of the scan, w0 << 32 | w1 << 16 | w2 */
+	uint64_t done;              /* Seeds before the batch */
+	struct PlanSys *scratch;    /* query->systems per worker */
+	ScanHits *found;            /* Per worker */
+} ScanJob;
+
+static inline struct SeedType seed_from_index(uint64_t index)
+{
+	return (struct SeedType){(uint16_t)(index >> 32), (uint16_t)(index >> 16), (uint16_t)index};
+}
+
+/* Parse comma-separated predicates, eg. name=7:LAVE,anarchy-tl15,dense=12 */
+bool parse_scan_query(const char *text, ScanQuery *query)
+{
+	char copy[256], *save = NULL;
+	*query = (ScanQuery){0};
+
+	if(strlen(text) >= sizeof(copy)) return false;
+	strcpy(copy, text);
+	for(char *term = strtok_r(copy, ",", &save); term != NULL; term = strtok_r(NULL, ",", &save))
+	{
+		long index, count;
+		char name[16];
+		int used = 0;
+
+		if(sscanf(term, "name=%ld:%15[A-Za-z]%n", &index, name, &used) == 2 && term[used] == 0 &&
+		   index >= 0 && index < GalaxySize && strlen(name) <= NAME_WIDTH)
+		{
+			for(size_t i = 0; name[i]; i++) query->name[i] = (char)toupper(name[i]);
+			query->name[strlen(name)] = 0;
+			query->nameIndex = (PlanetNum)index;
+		}
+		else if(strcmp(term, "anarchy-tl15") == 0)
+			query->anarchyNearTech = true, query->systems = GalaxySize;
+		else if(sscanf(term, "dense=%ld%n", &count, &used) == 1 && term[used] == 0 && count > 0 && count < GalaxySize)
+			query->dense = (uint32_t)count, query->systems = GalaxySize;
+		else
+			return false;
+	}
+	return query->name[0] != 0 || query->systems != 0;
+}
+
+/* Cheap box test first; the rounding is left to distance() itself */
+static inline bool scan_in_range(const struct PlanSys *a, const struct PlanSys *b)
+{
+	int dx = a->x - b->x, dy = a->y - b->y;
+	if(abs(dx) > MaxFuel / 4 + 1 || abs(dy) > MaxFuel / 2 + 1) return false;
+	return distance((struct SysCoord){(uint8_t)a->x, (uint8_t)a->y},
+	                (struct SysCoord){(uint8_t)b->x, (uint8_t)b->y}) <= MaxFuel;
+}
+
+bool scan_matches(const ScanQuery *query, uint64_t index, struct PlanSys *systems)
+{
+	struct SeedType seed = seed_from_index(index);
+
+	if(query->name[0])
+	{
+		struct SeedType at = seed;
+		for(uint32_t i = 0; i < 4u * query->nameIndex; i++) tweak_seed(&at);
+		if(strcmp(make_system(&at).name, query->name) != 0) return false;
+	}
+	if(query->systems == 0) return true;
+
+	for(PlanetNum i = 0; i < query->systems; i++) systems[i] = make_system(&seed);
+
+	if(query->anarchyNearTech)
+	{
+		bool found = false;
+		for(PlanetNum i = 0; i < query->systems && !found; i++)
+		{
+			if(systems[i].govType != 0) continue;
+			for(PlanetNum j = 0; j < query->systems && !found; j++)
+				found = systems[j].techLev == 14 && scan_in_range(&systems[i], &systems[j]);
+		}
+		if(!found) return false;
+	}
+	if(query->dense != 0)
+	{
+		bool found = false;
+		for(PlanetNum i = 0; i < query->systems && !found; i++)
+		{
+			uint32_t near = 0;
+			for(PlanetNum j = 0; j < query->systems && near < query->dense; j++)
+				near += j != i && scan_in_range(&systems[i], &systems[j]);
+			found = near >= query->dense;
+		}
+		if(!found) return false;
+	}
+	return true;
+}
+
+void scan_range(void *context, uint32_t worker, uint32_t begin, uint32_t end)
+{
+	ScanJob *job = context;
+	struct PlanSys *systems = job->scratch + (size_t)worker * job->query->systems;
+
+	ScanHits *found = &job->found[worker];
+
+	for(uint32_t n = begin; n < end; n++)
+	{
+		uint64_t offset = job->done + n;
+		if(!scan_matches(job->query, (job->first + offset) & 0xFFFFFFFFFFFFull, systems)) continue;
+		if(found->count == SCAN_MAX_HITS && found->offset[SCAN_MAX_HITS - 1] < offset) continue;
+
+		/* Ranges may be stolen out of order, so insert rather than append */
+		uint32_t at = found->count < SCAN_MAX_HITS ? found->count++ : SCAN_MAX_HITS - 1;
+		for(; at > 0 && found->offset[at - 1] > offset; at--) found->offset[at] = found->offset[at - 1];
+		found->offset[at] = offset;
+	}
+}
+
+int compare_uint64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Try count base seeds from start and list the first SCAN_MAX_HITS that
+ * match, whatever the thread count: a batch is finished before its hits
+ * are merged, and the scan stops only after a batch that fills the list.
+ */
+void scan_seeds(const ScanQuery *query, struct SeedType start, uint64_t count)
+{
+	ScanJob job = {.query = query};
+	uint64_t hits[SCAN_MAX_HITS * (MAX_WORKERS + 1)];
+	uint32_t matches = 0;
+	struct timespec began;
+
+	start_workers();
+	job.first = (uint64_t)start.w0 << 32 | (uint64_t)start.w1 << 16 | start.w2;
+	job.scratch = malloc((size_t)Pool.workers * (query->systems > 0 ? query->systems : 1) * sizeof(struct PlanSys));
+	job.found = calloc(Pool.workers, sizeof(ScanHits));
+	if(job.scratch == NULL || job.found == NULL) stop("Out of memory");
+
+	printf("Scanning %llu seeds from %04X:%04X:%04X on %u thread(s)\n", (unsigned long long)count,
+	       start.w0, start.w1, start.w2, Pool.workers);
+	timespec_get(&began, TIME_UTC);
+	while(job.done < count && matches < SCAN_MAX_HITS)
+	{
+		uint32_t batch = count - job.done < SCAN_BATCH ? (uint32_t)(count - job.done) : SCAN_BATCH;
+		parallel_for(batch, 1024, scan_range, &job);
+		job.done += batch;
+
+		for(uint32_t w = 0; w < Pool.workers; w++)
+		{
+			memcpy(hits + matches, job.found[w].offset, job.found[w].count * sizeof(uint64_t));
+			matches += job.found[w].count;
+			job.found[w].count = 0;
+		}
+		qsort(hits, matches, sizeof(uint64_t), compare_uint64);
+		if(matches > SCAN_MAX_HITS) matches = SCAN_MAX_HITS;
+	}
+	double seconds = elapsed_seconds(&began);
+
+	for(uint32_t i = 0; i < matches; i++)
+	{
+		struct SeedType seed = seed_from_index((job.first + hits[i]) & 0xFFFFFFFFFFFFull);
+		printf("%04X:%04X:%04X\n", seed.w0, seed.w1, seed.w2);
+	}
+	printf("%u match(es)%s in %llu seeds, %.2f s (%.0f seeds/s)\n", matches,
+	       matches == SCAN_MAX_HITS ? " (stopped at limit)" : "", (unsigned long long)job.done, seconds,
+	       seconds > 0 ? job.done / seconds : 0.0);
+	free(job.scratch);
+	free(job.found);
+}
+
+/* ====================================== *
+ * State digests for replay verification  *
+ * ====================================== */
+
+/*
+ * After each command the whole game state is folded into a rolling 64-bit
+ * hash. --digest writes one hex digest per command; --verify compares a
+ * run against such a file and names the first command that differs.
+ */
+FILE *DigestOut;
+uint64_t *DigestReference;      /* From --verify */
+size_t DigestReferenceCount;
+uint64_t DigestState;
+uint64_t DigestCommands;
+uint64_t DigestDiverged;        /* Command number of the first mismatch, or 0 */
+uint64_t DigestNpcRuns, DigestNpcHash;  /* NPC world hash, redone only when NpcWorld.runs moves */
+
+static inline uint64_t digest_mix(uint64_t hash, uint64_t value)
+{
+	hash = (hash ^ value) * 0x9E3779B97F4A7C15;
+	return hash ^ hash >> 29;
+}
+
+uint64_t digest_commander(uint64_t hash, const Commander *cmdr)
+{
+	for(uint16_t i = 0; i <= LAST_TRADE; i++)
+		hash = digest_mix(hash, (uint64_t)cmdr->shipHold[i] << 32 | (uint64_t)cmdr->localMarket.quantity[i] << 16 |
+		                        cmdr->localMarket.price[i]);
+	hash = digest_mix(hash, (uint64_t)(uint32_t)cmdr->currentPlanet << 32 | (uint64_t)cmdr->galaxyNum << 16 | cmdr->fuel);
+	hash = digest_mix(hash, (uint64_t)cmdr->cash);
+	hash = digest_mix(hash, (uint64_t)cmdr->fluctuation << 16 | cmdr->holdSpace);
+	return hash;
+}
+
+/* The current galaxy's market drift and the tick it is current to */
+uint64_t digest_economy(uint64_t hash)
+{
+	const int16_t *drift;
+
+	hash = digest_mix(hash, EconomyTick);
+	if(EconomyDrift == NULL) return hash;
+	hash = digest_mix(hash, EconomyGalaxyTick[Player.galaxyNum - 1]);
+	drift = economy_drift(Player.galaxyNum, 0);
+	for(uint32_t i = 0; i < (uint32_t)(LAST_TRADE + 1) * (uint32_t)GalaxySize; i++)
+		hash = digest_mix(hash, (uint16_t)drift[i]);
+	return hash;
+}
+
+/* Traders and their markets, hashed again only after an npc command has changed them */
+uint64_t digest_npc_world(void)
+{
+	uint64_t hash = 0;
+
+	if(DigestNpcRuns == NpcWorld.runs) return DigestNpcHash;
+	hash = digest_mix(hash, (uint64_t)NpcWorld.galaxyNum << 32 | NpcWorld.agents);
+	hash = digest_mix(hash, NpcWorld.ticks);
+	for(uint32_t n = 0; n < NpcWorld.agents; n++)
+	{
+		const NpcTrader *trader = &NpcWorld.trader[n];
+		hash = digest_mix(hash, (uint64_t)(uint32_t)trader->at << 32 | (uint64_t)trader->item << 16 | trader->carried);
+		hash = digest_mix(hash, (uint64_t)trader->cash);
+		hash = digest_mix(hash, trader->randState);
+	}
+	for(PlanetNum i = 0; NpcWorld.market != NULL && i < GalaxySize; i++)
+		for(uint16_t k = 0; k <= LAST_TRADE; k++) hash = digest_mix(hash, NpcWorld.market[i].quantity[k]);
+
+	DigestNpcRuns = NpcWorld.runs;
+	return DigestNpcHash = hash;
+}
+
+/* Fold in the state after a command: player, random stream, economy, every market the player or NPCs changed */
+void digest_command(const char *command)
+{
+	DigestState = digest_commander(DigestState, &Player);
+	DigestState = digest_mix(DigestState, (uint64_t)lastrand << 32 | (uint64_t)NativeRand << 31 | (uint32_t)RandCalls);
+	DigestState = digest_economy(DigestState);
+	DigestState = digest_mix(DigestState, (uint64_t)MarketDeltaCount << 1 | PersistentMarkets);
+	DigestState = digest_mix(DigestState, MarketDeltaHash);
+	DigestState = digest_mix(DigestState, digest_npc_world());
+	DigestCommands++;
+
+	if(DigestOut != NULL) fprintf(DigestOut, "%016llx\n", (unsigned long long)DigestState);
+	if(DigestReference != NULL && DigestDiverged == 0 &&
+	   (DigestCommands > DigestReferenceCount || DigestReference[DigestCommands - 1] != DigestState))
+	{
+		DigestDiverged = DigestCommands;
+		ExitStatus = EXIT_FAILURE;
+		fprintf(stderr, "Replay diverges at command %llu: %.*s\n", (unsigned long long)DigestCommands,
+		        (int)strcspn(command, "\r\n"), command);
+	}
+}
+
+/* Read a --digest file to check this run against */
+bool load_digest_reference(const char *path)
+{
+	FILE *in = fopen(path, "r");
+	unsigned long long value;
+	size_t capacity = 1024;
+
+	if(in == NULL) return false;
+	DigestReference = malloc(capacity * sizeof(uint64_t));
+	if(DigestReference == NULL) stop("Out of memory");
+	while(fscanf(in, "%llx", &value) == 1)
+	{
+		if(DigestReferenceCount == capacity)
+		{
+			DigestReference = realloc(DigestReference, (capacity *= 2) * sizeof(uint64_t));
+			if(DigestReference == NULL) stop("Out of memory");
+		}
+		DigestReference[DigestReferenceCount++] = value;
+	}
+	fclose(in);
+	return true;
+}
+
+/* Before exiting: close the stream, or report how verification went */
+void digest_finish(void)
+{
+	if(DigestOut != NULL) fclose(DigestOut);
+	if(DigestReference == NULL) return;
+	if(DigestDiverged == 0 && DigestCommands < DigestReferenceCount)
+	{
+		fprintf(stderr, "Replay ended after %llu of %zu commands\n", (unsigned long long)DigestCommands,
+		        DigestReferenceCount);
+		ExitStatus = EXIT_FAILURE;
+	}
+	else if(DigestDiverged == 0)
+		fprintf(stderr, "Replay matches all %llu commands\n", (unsigned long long)DigestCommands);
+}
+
+/* ============================== *
+ * Hibernating idle sessions      *
+ * ============================== */
+
+#define HIBERNATE_BYTES (256)
+
+/*
+ * A session idle past --hibernate-after seconds is squeezed into a few
+ * dozen bytes of varints: where the commander is, cash, fuel and hold, the
+ * fluctuation the market was rolled from and the random stream's word.
+ * The market is regenerated on waking, so only stock that differs from the
+ * regenerated market is kept, or the whole market in the rare case its
+ * prices cannot be rebuilt (after galhyp, say). The commander is wiped and
+ * the neighbour cache freed if its thread is idle, the only memory this
+ * gives back; waking rebuilds both.
+ */
+typedef struct {
+	uint8_t bytes[HIBERNATE_BYTES];
+	size_t length;
+} Hibernation;
+
+uint32_t HibernateAfter;  /* Seconds idle; 0 never */
+Hibernation Hibernated;
+
+static inline uint64_t zigzag(int64_t value) { return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+static inline int64_t unzigzag(uint64_t value) { return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+
+void put_varint(Hibernation *h, uint64_t value)
+{
+	do
+	{
+		if(h->length == HIBERNATE_BYTES) stop("Hibernation overflow");
+		h->bytes[h->length++] = (uint8_t)((value & 0x7F) | (value > 0x7F ? 0x80 : 0));
+		value >>= 7;
+	} while(value != 0);
+}
+
+uint64_t get_varint(const uint8_t **from)
+{
+	uint64_t value = 0;
+	for(unsigned shift = 0; ; shift += 7)
+	{
+		uint8_t b = *(*from)++;
+		value |= (uint64_t)(b & 0x7F) << shift;
+		if(!(b & 0x80)) return value;
+	}
+}
+
+/* The market a commander would be given on arriving now, before any trading */
+MarketType rebuilt_market(const Commander *cmdr)
+{
+	Commander copy = *cmdr;
+	copy.localMarket = generate_market(cmdr->fluctuation, sys_economy(Universe[cmdr->galaxyNum - 1].attrs[cmdr->currentPlanet]));
+	if(EconomyTick > 0) economy_market(&copy);
+	market_restore(&copy);
+	return copy.localMarket;
+}
+
+void hibernate_session(void)
+{
+	Hibernation *h = &Hibernated;
+	MarketType rebuilt = rebuilt_market(&Player);
+	bool verbatim = memcmp(rebuilt.price, Player.localMarket.price, sizeof(rebuilt.price)) != 0;
+	uint32_t held = 0, differs = 0;
+
+	h->length = 0;
+	put_varint(h, Player.galaxyNum);
+	put_varint(h, (uint64_t)Player.currentPlanet);
+	put_varint(h, zigzag(Player.cash));
+	put_varint(h, Player.fuel);
+	put_varint(h, Player.holdSpace);
+	put_varint(h, Player.fluctuation);
+	put_varint(h, lastrand);
+
+	for(uint16_t i = 0; i <= LAST_TRADE; i++)
+	{
+		if(Player.shipHold[i]) held |= 1u << i;
+		if(Player.localMarket.quantity[i] != rebuilt.quantity[i]) differs |= 1u << i;
+	}
+	put_varint(h, held);
+	for(uint16_t i = 0; i <= LAST_TRADE; i++)
+		if(held & 1u << i) put_varint(h, Player.shipHold[i]);
+
+	put_varint(h, verbatim);
+	for(uint16_t i = 0; verbatim && i <= LAST_TRADE; i++)
+	{
+		put_varint(h, Player.localMarket.quantity[i]);
+		put_varint(h, Player.localMarket.price[i]);
+	}
+	if(!verbatim)
+	{
+		put_varint(h, differs);
+		for(uint16_t i = 0; i <= LAST_TRADE; i++)
+			if(differs & 1u << i) put_varint(h, zigzag((int64_t)Player.localMarket.quantity[i] - rebuilt.quantity[i]));
+	}
+
+	memset(&Player, 0, sizeof(Player));
+	lastrand = 0;
+	neighbour_release();
+}
+
+void wake_session(void)
+{
+	const uint8_t *from = Hibernated.bytes;
+	uint32_t held, differs;
+
+	Player.galaxyNum = (uint16_t)get_varint(&from);
+	Player.currentPlanet = (PlanetNum)get_varint(&from);
+	Player.cash = unzigzag(get_varint(&from));
+	Player.fuel = (uint16_t)get_varint(&from);
+	Player.holdSpace = (uint16_t)get_varint(&from);
+	Player.fluctuation = (uint8_t)get_varint(&from);
+	lastrand = (unsigned int)get_varint(&from);
+
+	held = (uint32_t)get_varint(&from);
+	for(uint16_t i = 0; i <= LAST_TRADE; i++)
+		Player.shipHold[i] = held & 1u << i ? (uint16_t)get_varint(&from) : 0;
+
+	if(get_varint(&from))
+	{
+		for(uint16_t i = 0; i <= LAST_TRADE; i++)
+		{
+			Player.localMarket.quantity[i] = (uint16_t)get_varint(&from);
+			Player.localMarket.price[i] = (uint16_t)get_varint(&from);
+		}
+	}
+	else
+	{
+		Player.localMarket = rebuilt_market(&Player);
+		differs = (uint32_t)get_varint(&from);
+		for(uint16_t i = 0; i <= LAST_TRADE; i++)
+			if(differs & 1u << i) Player.localMarket.quantity[i] += (uint16_t)unzigzag(get_varint(&from));
+	}
+
+	build_galaxy_data(Player.galaxyNum);
+	neighbour_request(Player.galaxyNum, Player.currentPlanet);
+}
+
+/* Input read with read() rather than stdio, so poll() sees everything not yet taken */
+struct {
+	char data[0x400];
+	size_t length;
+	bool ended;
+} Input;
+
+/* Wait for input, hibernating once idle for HibernateAfter seconds and waking when it comes */
+void await_input(void)
+{
+#ifndef _WIN32
+	struct pollfd input = {.fd = STDIN_FILENO, .events = POLLIN};
+
+	fflush(stdout);
+	if(poll(&input, 1, (int)(HibernateAfter * 1000)) != 0) return;
+	hibernate_session();
+	while(poll(&input, 1, -1) < 0);
+	wake_session();
+#endif
+}
+
+/* Next line into line as fgets() would, polling only while no whole line is buffered */
+bool read_command(char *line, size_t size)
+{
+#ifndef _WIN32
+	if(HibernateAfter == 0) return fgets(line, (int)size, stdin) != NULL;
+
+	for(;;)
+	{
+		char *newline = memchr(Input.data, '\n', Input.length);
+		size_t take = newline != NULL ? (size_t)(newline - Input.data) + 1 : Input.ended ? Input.length : 0;
+
+		if(take > size - 1 || (take == 0 && Input.length >= size - 1)) take = size - 1;
+		if(take > 0)
+		{
+			memcpy(line, Input.data, take);
+			line[take] = '\0';
+			Input.length -= take;
+			memmove(Input.data, Input.data + take, Input.length);
+			return true;
+		}
+		if(Input.ended) return false;
+
+		await_input();
+		ssize_t got = read(STDIN_FILENO, Input.data + Input.length, sizeof(Input.data) - Input.length);
+		if(got > 0) Input.length += (size_t)got;
+		else if(got == 0 || errno != EINTR) Input.ended = true;
+	}
+#else
+	return fgets(line, (int)size, stdin) != NULL;
+#endif
+}
+
+/* ================================== *
+ * Spectator feed in shared memory    *
+ * ================================== */
+
+#define FEED_MAGIC "TEFEED1"
+#define FEED_SLOTS (4096)  /* A power of two */
+#define FEED_WORDS (7)
+
+enum { FEED_STATE = 1, FEED_TRADE = 2 };
+
+/*
+ * With --feed file the game publishes an event into a ring mapped from the
+ * file after every command that changes the commander, and one per trade.
+ * There is a single writer and it never waits: each slot is a seqlock,
+ * odd while being written and 2n+2 once it holds event n. Any number of
+ * --spectate readers map the file read-only, copy a slot between two reads
+ * of its sequence, and skip ahead if the writer has lapped them.
+ *
+ * word[0] kind << 56 | command number, word[1] cash,
+ * word[2] galaxy << 48 | planet << 16 | fuel, then for a state event the
+ * hold (goods 0-15, four to a word; alien items are never on sale) or for
+ * a trade item << 48 | units bought (negative if sold) << 16 | price.
+ */
+typedef struct {
+	_Atomic uint64_t sequence;
+	_Atomic uint64_t word[FEED_WORDS];
+} FeedSlot;
+
+typedef struct {
+	char magic[8];
+	uint32_t slots;
+	_Atomic uint32_t closed;   /* Set as the game exits */
+	_Atomic uint64_t head;     /* Events published */
+	char pad[64 - 24];         /* Slots start on a cache line */
+	FeedSlot slot[FEED_SLOTS];
+} FeedRing;
+
+static_assert(sizeof(FeedSlot) == 64, "FeedSlot must fill one cache line");
+
+FeedRing *Feed;
+uint64_t FeedCommand;             /* Commands run so far */
+Commander FeedLast;               /* As of the last state event */
+
+void feed_publish(uint64_t kind, uint64_t command, const Commander *cmdr, const uint64_t *extra)
+{
+	uint64_t n = atomic_load_explicit(&Feed->head, memory_order_relaxed);
+	FeedSlot *slot = &Feed->slot[n & (FEED_SLOTS - 1)];
+	uint64_t word[FEED_WORDS] = {
+		kind << 56 | command, (uint64_t)cmdr->cash,
+		(uint64_t)cmdr->galaxyNum << 48 | (uint64_t)(uint32_t)cmdr->currentPlanet << 16 | cmdr->fuel,
+		extra[0], extra[1], extra[2], extra[3]
+	};
+
+	atomic_store_explicit(&slot->sequence, 2 * n + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	for(int w = 0; w < FEED_WORDS; w++) atomic_store_explicit(&slot->word[w], word[w], memory_order_relaxed);
+	atomic_store_explicit(&slot->sequence, 2 * n + 2, memory_order_release);
+	atomic_store_explicit(&Feed->head, n + 1, memory_order_release);
+}
+
+/* After a command: publish the commander if cash, position, fuel or hold moved */
+void feed_command(void)
+{
+	uint64_t hold[4] = {0};
+
+	FeedCommand++;
+	if(Player.cash == FeedLast.cash && Player.galaxyNum == FeedLast.galaxyNum &&
+	   Player.currentPlanet == FeedLast.currentPlanet && Player.fuel == FeedLast.fuel &&
+	   memcmp(Player.shipHold, FeedLast.shipHold, sizeof(Player.shipHold)) == 0) return;
+	FeedLast = Player;
+	for(uint16_t i = 0; i < ALIEN_ITEMS; i++) hold[i / 4] |= (uint64_t)Player.shipHold[i] << (16 * (i % 4));
+	feed_publish(FEED_STATE, FeedCommand, &Player, hold);
+}
+
+/* The player bought (change > 0) or sold units of a good here */
+void player_traded(uint16_t itemIndex, int32_t change)
+{
+	market_record_trade(&Player, itemIndex, -change);
+	if(Feed == NULL || change == 0) return;
+	uint64_t trade[4] = {(uint64_t)itemIndex << 48 | (uint64_t)(uint32_t)change << 16 | Player.localMarket.price[itemIndex]};
+	feed_publish(FEED_TRADE, FeedCommand + 1, &Player, trade);  /* During the next command */
+}
+
+void feed_close(void)
+{
+	atomic_store_explicit(&Feed->closed, 1, memory_order_release);
+}
+
+/* Map a feed file, creating it for the game or read-only for a spectator */
+FeedRing *map_feed(const char *path, bool writer)
+{
+#ifdef _WIN32
+	(void)path; (void)writer;
+	return NULL;  /* No mmap */
+#else
+	int fd = writer ? open(path, O_RDWR | O_CREAT | O_TRUNC, 0644) : open(path, O_RDONLY);
+	struct stat info;
+	FeedRing *ring;
+
+	if(fd < 0) return NULL;
+	if((writer && ftruncate(fd, sizeof(FeedRing)) != 0) || fstat(fd, &info) != 0 || (size_t)info.st_size != sizeof(FeedRing))
+	{
+		close(fd);
+		return NULL;
+	}
+	ring = mmap(NULL, sizeof(FeedRing), writer ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(ring == MAP_FAILED) return NULL;
+	if(writer)
+	{
+		memcpy(ring->magic, FEED_MAGIC, sizeof(ring->magic));
+		ring->slots = FEED_SLOTS;
+	}
+	else if(memcmp(ring->magic, FEED_MAGIC, sizeof(ring->magic)) != 0 || ring->slots != FEED_SLOTS)
+	{
+		munmap(ring, sizeof(FeedRing));
+		return NULL;
+	}
+	return ring;
+#endif
+}
+
+/* Copy event n: 1 if copied, 0 if not written yet, -1 if the writer has lapped it */
+int feed_read(FeedRing *ring, uint64_t n, uint64_t *word)
+{
+	FeedSlot *slot = &ring->slot[n & (FEED_SLOTS - 1)];
+
+	for(;;)
+	{
+		uint64_t before = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+		if(before == 2 * n + 1) continue;  /* Being written */
+		if(before < 2 * n + 2) return 0;
+		if(before > 2 * n + 2) return -1;
+		for(int w = 0; w < FEED_WORDS; w++) word[w] = atomic_load_explicit(&slot->word[w], memory_order_relaxed);
+		atomic_thread_fence(memory_order_acquire);
+		if(atomic_load_explicit(&slot->sequence, memory_order_relaxed) == before) return 1;
+	}
+}
+
+void print_feed_event(const uint64_t *word)
+{
+	char name[NAME_WIDTH + 1], cash[MONEY_WIDTH], fuel[MONEY_WIDTH];
+	uint16_t galaxyNum = (uint16_t)(word[2] >> 48);
+	PlanetNum planet = (PlanetNum)(uint32_t)(word[2] >> 16);
+
+	if(galaxyNum >= 1 && galaxyNum <= GalaxyCount && planet >= 0 && planet < GalaxySize)
+		get_system_name(&Universe[galaxyNum - 1], planet, name);
+	else
+		strcpy(name, "?");
+	printf("#%-6llu %u:%-8s %10s CR %4s LY", (unsigned long long)(word[0] & ((1ull << 56) - 1)), galaxyNum, name,
+	       format_tenths((Money)word[1], cash), format_tenths((uint16_t)word[2], fuel));
+
+	if(word[0] >> 56 == FEED_TRADE)
+	{
+		uint16_t item = (uint16_t)(word[3] >> 48);
+		int32_t units = (int32_t)(uint32_t)(word[3] >> 16);
+		if(item > LAST_TRADE) item = LAST_TRADE;
+		printf("  %s %i%s %s at %s\n", units > 0 ? "bought" : "sold", units > 0 ? units : -units,
+		       UnitNames[Commodities[item].units], Commodities[item].name, format_tenths((uint16_t)word[3], cash));
+		return;
+	}
+	printf("  hold");
+	for(uint16_t i = 0; i < ALIEN_ITEMS; i++)
+	{
+		uint16_t units = (uint16_t)(word[3 + i / 4] >> (16 * (i % 4)));
+		if(units) printf(" %s %u%s", Commodities[i].name, units, UnitNames[Commodities[i].units]);
+	}
+	printf("\n");
+}
+
+/* Tail a feed from its oldest event still in the ring until the game exits */
+bool spectate(const char *path)
+{
+	FeedRing *ring = map_feed(path, false);
+	uint64_t next, word[FEED_WORDS];
+	struct timespec nap = {0, 1000000};
+
+	if(ring == NULL) return false;
+	next = atomic_load_explicit(&ring->head, memory_order_acquire);
+	next = next > FEED_SLOTS ? next - FEED_SLOTS : 0;
+	for(;;)
+	{
+		int got = feed_read(ring, next, word);
+		if(got > 0)
+		{
+			print_feed_event(word);
+			next++;
+		}
+		else if(got < 0)
+		{
+			uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+			printf("(skipped %llu events)\n", (unsigned long long)(head - FEED_SLOTS / 2 - next));
+			next = head - FEED_SLOTS / 2;
+		}
+		else if(atomic_load_explicit(&ring->closed, memory_order_acquire) &&
+		        next >= atomic_load_explicit(&ring->head, memory_order_acquire))
+			return true;
+		else
+		{
+			fflush(stdout);
+			nanosleep(&nap, NULL);
+		}
+	}
+}
+
+/* Various command functions */
+bool do_tweak_random_native(char *commandArguments) 
+{
+	(void)commandArguments; // Mark 's' as unused
+	NativeRand ^=1;
+	return true;
+}
+
+bool do_local_systems_display(char *commandArguments)
+{
+	PlanetNum *near = malloc(GalaxySize * sizeof(PlanetNum));
+	uint16_t *distances = malloc(GalaxySize * sizeof(uint16_t));
+	PlanetNum count;
+	(void)(&commandArguments);
+
+	if(near == NULL || distances == NULL) stop("Out of memory");
+	count = neighbours_of(Player.galaxyNum, Player.currentPlanet, near, distances);
+
+	printf("Galaxy number %i",Player.galaxyNum);
+	for(PlanetNum k = 0; k < count; ++k)
+	{
+		PlanetNum syscount = near[k];
+		uint16_t d = distances[k];
+
+		if( d <= Player.fuel )
+			printf("\n * ");
+		else
+			printf("\n - ");
+
+		print_system_info( Galaxy, syscount, true );
+		printf(" (%.1f LY)", (float)d / 10);
+	}
+
+	free(near);
+	free(distances);
+	return true;
+}
+
+
+/* Jump to planet name s */
+bool do_jump(char *commandArguments)
+{
+	uint16_t d;
+	PlanetNum dest=find_matching_system_name(commandArguments);
+
+	if(dest==Player.currentPlanet)
+	{
+		printf("\nBad jump");
+		return false;
+	}
+
+	d=distance(Galaxy->coord[dest],Galaxy->coord[Player.currentPlanet]);
+
+	if (d>Player.fuel)
+	{
+		printf("\nJump to far");
+		return false;
+	}
+
+	Player.fuel-=d;
+	execute_jump_to_planet(&Player, dest, random_byte());
+	if(EconomyTick > 0) economy_market(&Player);  /* Once the clock runs, markets drift */
+	market_restore(&Player);
+	neighbour_request(Player.galaxyNum, Player.currentPlanet);
+	print_system_info(Galaxy,Player.currentPlanet,false);
+	return true;
+}
+
+/* As dojump but no fuel cost */
+bool do_sneak(char *commandArguments)
+{
+	uint16_t fuelkeep=Player.fuel;
+	bool b;
+	Player.fuel=666;
+	b=do_jump(commandArguments);
+	Player.fuel=fuelkeep;
+	return b;
+}
+
+
+/* Jump to next galaxy */
+bool do_galactic_hyperspace(char *commandArguments)
+/*
+ * Preserve planetnum (eg. if leave 7th planet
+ * arrive at 7th planet) 
+ * Classic Elite always jumped to planet nearest (0x60,0x60)
+ */
+{
+	(void)(&commandArguments);     /* Discard s */
+	Player.galaxyNum++;
+	if(Player.galaxyNum > GalaxyCount) {Player.galaxyNum=1;}
+	build_galaxy_data(Player.galaxyNum);
+	neighbour_request(Player.galaxyNum, Player.currentPlanet);
+	return true;
+}
+
+/* Info on planet */
+bool do_planet_info_display(char *commandArguments)
+{
+	PlanetNum dest=find_matching_system_name(commandArguments);
+	print_system_info(Galaxy,dest,false);
+	return true;
+}
+
+
+/* 
+ * Find systems matching a query, eg. "find e0 g7 d20" or "find g0 t10+".
+ * Terms: eN economy, gN government, tN tech level, pN population (billions),
+ * with + or - suffix for at least/at most. Terms are ANDed, "|" separates
+ * alternatives, a leading "!" negates a term. dN keeps systems within N LY
+ * of the current one; "*" searches every galaxy rather than this one.
+ */
+bool do_find(char *commandArguments)
+{
+	char term[MAX_LEN];
+	SystemSet result, conjunction, termSet;
+	uint16_t maxDistance = UINT16_MAX;
+	int64_t tenths;
+	bool allGalaxies = false, ok = true;
+	uint32_t found = 0, firstWord = 0, lastWord, firstBit = 0, endBit;
+
+	build_universe_index();
+	result = set_new();
+	conjunction = set_new();
+	termSet = set_new();
+	set_fill(&conjunction);
+
+	for(split_string_at_first_space(commandArguments, term); term[0] != 0;
+	    split_string_at_first_space(commandArguments, term))
+	{
+		bool negate = (term[0] == '!');
+		char *t = negate ? term + 1 : term;
+
+		if(strcmp(term, "|") == 0)
+		{
+			set_or(&result, &conjunction);
+			set_fill(&conjunction);
+		}
+		else if(strcmp(term, "*") == 0)
+			allGalaxies = true;
+		else if(!negate && tolower(t[0]) == 'd' && parse_tenths(t + 1, &tenths) && tenths >= 0 && tenths <= UINT16_MAX)
+			maxDistance = (uint16_t)tenths;
+		else if(query_term(t, &termSet))
+		{
+			if(negate) set_not(&termSet);
+			set_and(&conjunction, &termSet);
+		}
+		else
+		{
+			printf("\nBad query term (%s)", term);
+			ok = false;
+			break;
+		}
+	}
+	set_or(&result, &conjunction);
+
+	endBit = (uint32_t)GalaxyCount * GalaxySize;
+	if(!allGalaxies || maxDistance != UINT16_MAX)
+	{
+		/* Restrict to the current galaxy's run of bits */
+		firstBit = (uint32_t)(Player.galaxyNum - 1) * GalaxySize;
+		endBit = firstBit + GalaxySize;
+		firstWord = firstBit / 64;
+		if(ok) printf("Galaxy number %i", Player.galaxyNum);
+	}
+	lastWord = ok ? (endBit - 1) / 64 : 0;
+
+	for(uint32_t w = firstWord; ok && w <= lastWord; w++)
+	{
+		uint64_t bits = result.bits[w];
+		while(bits)
+		{
+			uint32_t systemBit = w * 64 + (uint32_t)__builtin_ctzll(bits);
+			uint16_t galcount = (uint16_t)(systemBit / GalaxySize);
+			PlanetNum syscount = (PlanetNum)(systemBit % GalaxySize);
+			bits &= bits - 1;
+			if(systemBit < firstBit || systemBit >= endBit) continue;
+
+			if(galcount == Player.galaxyNum - 1)
+			{
+				uint16_t d = distance(Galaxy->coord[syscount], Galaxy->coord[Player.currentPlanet]);
+				if(d > maxDistance) continue;
+				printf("\n   ");
+				print_system_info(Galaxy, syscount, true);
+				printf(" (%.1f LY)", (float)d / 10);
+			}
+			else
+			{
+				printf("\n G%i", galcount + 1);
+				print_system_info(&Universe[galcount], syscount, true);
+			}
+			found++;
+		}
+	}
+	if(ok) printf("\n%u found", found);
+	free(result.bits);
+	free(conjunction.bits);
+	free(termSet.bits);
+	return ok;
+}
+
+/* Plan a route to planet s, one tank of fuel per jump */
+bool do_route(char *commandArguments)
+{
+	const JumpGraph *graph;
+	PlanetNum *previous;
+	char name[NAME_WIDTH + 1];
+	PlanetNum dest = find_matching_system_name(commandArguments);
+
+	if(dest == Player.currentPlanet)
+	{
+		printf("\nBad route");
+		return false;
+	}
+
+	graph = jump_graph(Player.galaxyNum);
+	previous = malloc(GalaxySize * sizeof(PlanetNum));
+	if(previous == NULL) stop("Out of memory");
+
+	if(!route_fewest_jumps(graph, Player.currentPlanet, dest, previous))
+	{
+		get_system_name(Galaxy, dest, name);
+		printf("\nNo route to %s", name);
+		free(previous);
+		return false;
+	}
+	print_route("Fewest jumps", dest, previous);
+
+	route_least_fuel(graph, Player.currentPlanet, dest, previous);
+	print_route("Least fuel", dest, previous);
+	free(previous);
+	return true;
+}
+
+/*
+ * Simulate n commanders, each making up to j jumps from Lave with 100 CR and
+ * a 20t hold under the named strategy, and report how they ended up.
+ */
+bool do_sim(char *commandArguments)
+{
+	char name[MAX_LEN], cash[5][MONEY_WIDTH];
+	char *rest;
+	uint16_t i;
+	uint32_t count, jumpsEach;
+	double cashSum = 0, profitSum = 0, seconds;
+	struct timespec start;
+	SimJob job;
+
+	split_string_at_first_space(commandArguments, name);
+	i = match_string_in_array(name, strategies, NUM_STRATEGIES);
+	count = (uint32_t)strtoul(commandArguments, &rest, 10);
+	jumpsEach = (uint32_t)strtoul(rest, NULL, 10);
+
+	if(i == 0 || count == 0 || jumpsEach == 0)
+	{
+		printf("\nSim strategy commanders jumps, strategy one of:");
+		for(uint16_t k = 0; k < NUM_STRATEGIES; k++) printf(" %s", strategies[k]);
+		return false;
+	}
+
+	job.turn = stratfuncs[i - 1];
+	job.graph = jump_graph(1);  /* Built here, shared read-only by the workers */
+	job.jumpsEach = jumpsEach;
+	job.finalCash = malloc(count * sizeof(Money));
+	job.profitPerJump = malloc(count * sizeof(float));
+	atomic_init(&job.jumpsMade, 0);
+	if(job.finalCash == NULL || job.profitPerJump == NULL) stop("Out of memory");
+
+	timespec_get(&start, TIME_UTC);
+	parallel_for(count, 64, simulate_commanders, &job);
+	seconds = elapsed_seconds(&start);
+
+	qsort(job.finalCash, count, sizeof(Money), compare_money);
+	qsort(job.profitPerJump, count, sizeof(float), compare_float);
+	for(uint32_t n = 0; n < count; n++)
+	{
+		cashSum += (double)job.finalCash[n];
+		profitSum += job.profitPerJump[n];
+	}
+
+	printf("\n%s: %u commanders, %llu jumps on %u threads in %.2fs (%.0f jumps/s)", strategies[i - 1],
+	       count, (unsigned long long)job.jumpsMade, Pool.workers, seconds, (double)job.jumpsMade / seconds);
+	printf("\nFinal cash   min %s  10%% %s  median %s  90%% %s  max %s  mean %.1f",
+	       format_tenths(job.finalCash[0], cash[0]), format_tenths(job.finalCash[decile(count, 1)], cash[1]),
+	       format_tenths(job.finalCash[decile(count, 5)], cash[2]), format_tenths(job.finalCash[decile(count, 9)], cash[3]),
+	       format_tenths(job.finalCash[count - 1], cash[4]), cashSum / count / 10);
+	printf("\nProfit/jump  min %.1f  10%% %.1f  median %.1f  90%% %.1f  max %.1f  mean %.1f",
+	       job.profitPerJump[0] / 10, job.profitPerJump[decile(count, 1)] / 10,
+	       job.profitPerJump[decile(count, 5)] / 10, job.profitPerJump[decile(count, 9)] / 10,
+	       job.profitPerJump[count - 1] / 10, profitSum / count / 10);
+
+	free(job.finalCash);
+	free(job.profitPerJump);
+	return true;
+}
+
+/*
+ * Run n NPC traders for t ticks in the current galaxy's shared markets.
+ * The markets and traders carry on from the last npc command unless the
+ * galaxy has changed; a different n hires or lays off traders at the end
+ * of the list. The player's market deltas are the markets' stock.
+ */
+bool do_npc(char *commandArguments)
+{
+	char *rest;
+	uint32_t agents = (uint32_t)strtoul(commandArguments, &rest, 10);
+	uint32_t ticks = (uint32_t)strtoul(rest, NULL, 10);
+	const JumpGraph *graph;
+	uint64_t trades = 0, cash = 0;
+	uint32_t depleted = 0, stocked = 0;
+	const GalaxyColumns *galaxy;
+	struct timespec start;
+	double seconds;
+
+	if(agents == 0 || ticks == 0)
+	{
+		printf("\nNpc agents ticks");
+		return false;
+	}
+
+	if(NpcWorld.galaxyNum != Player.galaxyNum) npc_reset();
+	if(NpcWorld.agents != agents) npc_hire(agents);
+	npc_load_markets();
+	graph = jump_graph(NpcWorld.galaxyNum);
+	galaxy = &Universe[NpcWorld.galaxyNum - 1];
+	start_workers();
+	for(uint32_t w = 0; w < Pool.workers; w++) NpcWorld.counter[w].trades = 0;
+
+	timespec_get(&start, TIME_UTC);
+	for(uint32_t t = 0; t < ticks; t++)
+	{
+		parallel_for(agents, 256, npc_choose, (void *)graph);
+		npc_dock();
+		parallel_for((uint32_t)GalaxySize, 16, npc_settle, NULL);
+		parallel_for((uint32_t)GalaxySize, 64, npc_restock, NULL);
+	}
+	seconds = elapsed_seconds(&start);
+	NpcWorld.ticks += ticks;
+	NpcWorld.runs++;
+	npc_store_markets();
+
+	for(uint32_t w = 0; w < Pool.workers; w++) trades += NpcWorld.counter[w].trades;
+	for(uint32_t n = 0; n < agents; n++) cash += (uint64_t)NpcWorld.trader[n].cash;
+	for(PlanetNum i = 0; i < GalaxySize; i++)
+	{
+		const MarketType *baseline = &NpcWorld.baseline[sys_economy(galaxy->attrs[i])];
+		for(uint16_t k = 0; k < ALIEN_ITEMS; k++)
+		{
+			if(baseline->quantity[k] == 0) continue;
+			stocked++;
+			if(2 * NpcWorld.market[i].quantity[k] < baseline->quantity[k]) depleted++;
+		}
+	}
+
+	printf("\n%u traders, tick %llu: %llu trades on %u threads in %.3fs (%.0f trades/s)", agents,
+	       (unsigned long long)NpcWorld.ticks, (unsigned long long)trades, Pool.workers, seconds, trades / seconds);
+	printf("\nMean cash %.1f CR, %u of %u stocked goods below half their usual stock", (double)cash / agents / 10, depleted, stocked);
+	return true;
+}
+
+/*
+ * Advance the economy clock n ticks. The current galaxy is stepped every
+ * tick, others catch up when next visited; with "*" every galaxy is stepped.
+ */
+bool do_tick(char *commandArguments)
+{
+	char *rest;
+	uint32_t ticks = (uint32_t)strtoul(commandArguments, &rest, 10);
+	bool allGalaxies = strchr(rest, '*') != NULL;
+	uint16_t galaxies = allGalaxies ? GalaxyCount : 1;
+	struct timespec start;
+	double seconds;
+
+	if(ticks == 0)
+	{
+		printf("\nTick %llu", (unsigned long long)EconomyTick);
+		return true;
+	}
+
+	economy_start();
+	for(uint16_t g = 1; g <= GalaxyCount; g++)
+		if(allGalaxies || g == Player.galaxyNum) economy_catch_up(g);
+	timespec_get(&start, TIME_UTC);
+	for(uint32_t t = 0; t < ticks; t++)
+	{
+		EconomyTick++;
+		for(uint16_t g = 1; g <= GalaxyCount; g++)
+		{
+			if(allGalaxies || g == Player.galaxyNum)
+			{
+				economy_step(g, EconomyTick);
+				EconomyGalaxyTick[g - 1] = EconomyTick;
+			}
+		}
+	}
+	seconds = elapsed_seconds(&start);
+	economy_market(&Player);
+	market_restore(&Player);
+
+	printf("\nTick %llu: %u ticks of %u markets in %.1fus (%.2fus per tick)", (unsigned long long)EconomyTick,
+	       ticks, galaxies * GalaxySize, seconds * 1e6, seconds * 1e6 / ticks);
+	return true;
+}
+
+/*
+ * Best cargo for every pair of systems in jump range at baseline prices,
+ * within the current cash and free hold: lists the trades from here and
+ * the galaxy's best n (default 5) by profit per LY.
+ */
+bool do_arbitrage(char *commandArguments)
+{
+	uint32_t top = (uint32_t)strtoul(commandArguments, NULL, 10);
+	const JumpGraph *graph = jump_graph(Player.galaxyNum);
+	uint32_t edges = graph->offset[GalaxySize];
+	PlanetNum *bestFrom;
+	uint32_t *bestEdge, found = 0;
+	MarketType baseline[8];
+	int32_t units[8][LAST_TRADE + 1];
+	char cash[MONEY_WIDTH];
+	struct timespec start;
+	double seconds;
+	ArbitrageJob job;
+
+	if(top == 0) top = ARBITRAGE_TOP;
+	job.graph = graph;
+	job.galaxy = Galaxy;
+	job.edgeItem = malloc(edges * sizeof(uint16_t) + 1);
+	job.edgeProfit = malloc(edges * sizeof(int32_t) + 1);
+	bestFrom = malloc(top * sizeof(PlanetNum));
+	bestEdge = malloc(top * sizeof(uint32_t));
+	if(job.edgeItem == NULL || job.edgeProfit == NULL || bestFrom == NULL || bestEdge == NULL)
+		stop("Out of memory");
+
+	timespec_get(&start, TIME_UTC);
+	for(uint16_t economy = 0; economy < 8; economy++)
+	{
+		baseline[economy] = generate_market(0, economy);
+		affordable_units(&baseline[economy], Player.cash, Player.holdSpace, units[economy]);
+	}
+	for(uint16_t source = 0; source < 8; source++)
+	{
+		for(uint16_t dest = 0; dest < 8; dest++)
+		{
+			uint16_t item = 0;
+			job.pairProfit[source][dest] = best_trade(&baseline[source], &baseline[dest], units[source], &item);
+			job.pairItem[source][dest] = item;
+			job.pairUnits[source][dest] = units[source][item];
+		}
+	}
+	parallel_for((uint32_t)GalaxySize, 64, arbitrage_rows, &job);
+	seconds = elapsed_seconds(&start);
+
+	printf("Arbitrage with %s CR and %it free:", format_tenths(Player.cash, cash), Player.holdSpace);
+	for(uint32_t e = graph->offset[Player.currentPlanet]; e < graph->offset[Player.currentPlanet + 1]; e++)
+		if(job.edgeProfit[e] > 0) print_arbitrage(&job, Player.currentPlanet, e);
+
+	/* Keep the top few by profit per LY, insertion sorted */
+	for(PlanetNum from = 0; from < GalaxySize; from++)
+	{
+		for(uint32_t e = graph->offset[from]; e < graph->offset[from + 1]; e++)
+		{
+			uint32_t k;
+			float perLY = (float)job.edgeProfit[e] / (graph->hopDistance[e] > 0 ? graph->hopDistance[e] : 1);
+			if(job.edgeProfit[e] <= 0) continue;
+			for(k = found; k > 0; k--)
+			{
+				uint32_t other = bestEdge[k - 1];
+				float otherLY = (float)job.edgeProfit[other] / (graph->hopDistance[other] > 0 ? graph->hopDistance[other] : 1);
+				if(otherLY >= perLY) break;
+				if(k < top)
+				{
+					bestEdge[k] = other;
+					bestFrom[k] = bestFrom[k - 1];
+				}
+			}
+			if(k < top)
+			{
+				bestEdge[k] = e;
+				bestFrom[k] = from;
+				if(found < top) found++;
+			}
+		}
+	}
+	printf("\nBest in galaxy %i:", Player.galaxyNum);
+	for(uint32_t k = 0; k < found; k++) print_arbitrage(&job, bestFrom[k], bestEdge[k]);
+	printf("\n%u pairs in %.0fus", edges, seconds * 1e6);
+
+	free(job.edgeItem);
+	free(job.edgeProfit);
+	free(bestFrom);
+	free(bestEdge);
+	return true;
+}
+
+/* Search n-jump trading itineraries from here and show the most profitable */
+bool do_plan(char *commandArguments)
+{
+	uint32_t legs = (uint32_t)strtoul(commandArguments, NULL, 10);
+	const JumpGraph *graph = jump_graph(Player.galaxyNum);
+	PlanNode *layers, *arrivals, *path[PLAN_MAX_LEGS + 1];
+	uint32_t size[PLAN_MAX_LEGS + 1];
+	MarketType baseline[8];
+	char name[NAME_WIDTH + 1], money[MONEY_WIDTH];
+	int32_t startCash = (int32_t)(Player.cash > PLAN_MAX_CASH ? PLAN_MAX_CASH : Player.cash);  /* Before refuelling */
+	struct timespec start;
+	uint32_t done;
+	double seconds;
+	PlanJob job;
+
+	if(legs == 0 || legs > PLAN_MAX_LEGS)
+	{
+		printf("\nPlan 1 to %i jumps", PLAN_MAX_LEGS);
+		return false;
+	}
+
+	for(uint16_t economy = 0; economy < 8; economy++) baseline[economy] = generate_market(0, economy);
+	layers = malloc((size_t)(legs + 1) * PLAN_BEAM * sizeof(PlanNode));
+	arrivals = malloc(GalaxySize * sizeof(PlanNode));
+	job.best = malloc(GalaxySize * sizeof(_Atomic uint64_t));
+	if(layers == NULL || arrivals == NULL || job.best == NULL) stop("Out of memory");
+	job.graph = graph;
+	job.galaxy = Galaxy;
+	job.baseline = baseline;
+	job.firstMarket = &Player.localMarket;
+	job.holdSpace = Player.holdSpace;
+
+	timespec_get(&start, TIME_UTC);
+
+	/* Top the tank up first, as far as the cash goes */
+	layers[0].system = Player.currentPlanet;
+	layers[0].fuel = Player.fuel;
+	layers[0].cash = startCash;
+	layers[0].parent = UINT32_MAX;
+	while(layers[0].fuel < MaxFuel && layers[0].cash >= FuelCost)
+	{
+		layers[0].fuel++;
+		layers[0].cash -= FuelCost;
+	}
+	size[0] = 1;
+
+	for(done = 0; done < legs; done++)
+	{
+		PlanNode *next = layers + (size_t)(done + 1) * PLAN_BEAM;
+		uint32_t count = 0;
+
+		job.layer = layers + (size_t)done * PLAN_BEAM;
+		for(PlanetNum i = 0; i < GalaxySize; i++) atomic_init(&job.best[i], 0);
+		parallel_for(size[done], 16, plan_expand, &job);
+
+		/* Gather the arrivals, richest first, and keep a beam's worth */
+		for(PlanetNum i = 0; i < GalaxySize; i++)
+		{
+			uint64_t packed = atomic_load_explicit(&job.best[i], memory_order_relaxed);
+			if(packed == 0) continue;
+			arrivals[count].system = i;
+			arrivals[count].cash = (int32_t)((packed >> 32) - 1);
+			arrivals[count].fuel = (uint16_t)MaxFuel;
+			arrivals[count].parent = (uint32_t)packed;
+			count++;
+		}
+		qsort(arrivals, count, sizeof(PlanNode), compare_plan_nodes);
+		if(count > PLAN_BEAM) count = PLAN_BEAM;
+		memcpy(next, arrivals, count * sizeof(PlanNode));
+		size[done + 1] = count;
+		if(count == 0) break;
+	}
+	seconds = elapsed_seconds(&start);
+
+	if(done == 0)
+	{
+		printf("\nNo itinerary: not enough fuel or cash to leave");
+		free(layers);
+		free(arrivals);
+		free(job.best);
+		return false;
+	}
+
+	/* Walk back from the richest end point */
+	path[done] = &layers[(size_t)done * PLAN_BEAM];
+	for(uint32_t k = done; k > 0; k--) path[k - 1] = &layers[(size_t)(k - 1) * PLAN_BEAM + path[k]->parent];
+
+	printf("Plan for %u jumps: %s%s CR (%u threads, %.2fms)", done, path[done]->cash >= startCash ? "+" : "",
+	       format_tenths(path[done]->cash - startCash, money), Pool.workers, seconds * 1e3);
+	for(uint32_t k = 0; k < done; k++)
+	{
+		uint32_t e = graph->offset[path[k]->system];
+		int32_t cash, units;
+		uint16_t item;
+		while(graph->neighbour[e] != path[k + 1]->system) e++;
+		plan_leg(&job, path[k], e, k == 0, &cash, &item, &units);
+		get_system_name(Galaxy, path[k + 1]->system, name);
+		printf("\n%3u  %-8s ", k + 1, name);
+		if(cash + graph->hopDistance[e] * FuelCost > path[k]->cash)
+			printf("%.12s %3i%-2s", Commodities[item].name, units, UnitNames[Commodities[item].units]);
+		else
+			printf("%-17s", "(empty)");
+		printf("  %7s CR after %.1f LY", format_tenths(cash, money), (float)graph->hopDistance[e] / 10);
+	}
+
+	free(layers);
+	free(arrivals);
+	free(job.best);
+	return true;
+}
+
+/*
+ * Buy in one order the basket of goods that sells for the most profit at
+ * the named system's baseline market, within cash, free hold and stock.
+ */
+bool do_fill(char *commandArguments)
+{
+	PlanetNum dest = find_matching_system_name(commandArguments);
+	MarketType target;
+	char name[NAME_WIDTH + 1];
+	Money cost = 0, profit;
+	int32_t hold = 0;
+	char spent[MONEY_WIDTH], worth[MONEY_WIDTH];
+	Basket basket;
+
+	if(dest == Player.currentPlanet)
+	{
+		printf("\nBad fill");
+		return false;
+	}
+
+	target = baseline_market(Player.galaxyNum, dest);
+	profit = fill_basket(&basket, &Player.localMarket, &target, Player.cash, Player.holdSpace);
+	get_system_name(Galaxy, dest, name);
+	if(profit <= 0)
+	{
+		printf("\nNothing here sells at a profit in %s", name);
+		return false;
+	}
+
+	/* Check the whole basket before buying any of it */
+	for(uint16_t g = 0; g < basket.count; g++)
+	{
+		money_add(&cost, money_times(basket.price[g], basket.bestTake[g]));
+		if(basket.tonnes[g]) hold += basket.bestTake[g];
+		if(basket.bestTake[g] > Player.localMarket.quantity[basket.item[g]]) stop("Fill basket exceeds stock");
+	}
+	if(cost > Player.cash || hold > Player.holdSpace) stop("Fill basket exceeds cash or hold");
+
+	printf("\nFilling for %s:", name);
+	for(uint16_t g = 0; g < basket.count; g++)
+	{
+		uint16_t i = basket.item[g];
+		if(basket.bestTake[g] == 0) continue;
+		player_traded(i, execute_buy_order(&Player, i, (uint16_t)basket.bestTake[g]));
+		printf("\n   %s %3i%-2s %7s CR, sells for %7s CR", Commodities[i].name, basket.bestTake[g],
+		       UnitNames[Commodities[i].units], format_tenths(money_times(basket.price[g], basket.bestTake[g]), spent),
+		       format_tenths(money_times(target.price[i], basket.bestTake[g]), worth));
+	}
+	printf("\nCost %s CR, expected profit %s CR%s", format_tenths(cost, spent), format_tenths(profit, worth),
+	       basket.nodes > FILL_NODE_LIMIT ? " (search cut short)" : "");
+	return true;
+}
+
+bool do_hold(char *commandArguments)
+{
+	uint16_t a=(uint16_t)atoi(commandArguments);
+	uint16_t t=0;
+
+	for(uint16_t i = 0; i <= LAST_TRADE; ++i)
+	{
+		if (( Commodities[i].units ) == TONNES)
+			t += Player.shipHold[i];
+	}
+
+	if( t > a )
+	{
+		printf("\nHold too full");
+		return false;
+	}
+
+	Player.holdSpace=a - t;
+
+	return true;
 }
 
 /* Sell ammount S(2) of good S(1) */
@@ -790,7 +4517,8 @@ bool do_sell(char *commandArguments)
 
 	i-=1;
 
-	t=execute_sell_order(i,a);
+	t=execute_sell_order(&Player,i,a);
+	player_traded(i,-(int32_t)t);
 
 	if(t==0)
 	{
@@ -829,7 +4557,8 @@ bool do_buy(char *commandArguments)
 	} 
 	i-=1;
 
-	t=execute_buy_order(i,a);
+	t=execute_buy_order(&Player,i,a);
+	player_traded(i,t);
 	if(t==0)
 		printf("Cannot buy any ");
 	else
@@ -844,19 +4573,19 @@ bool do_buy(char *commandArguments)
 }
 
 /* Attempt to buy f tonnes of fuel */
-uint16_t calculate_fuel_purchase(uint16_t fuelAmount)
+uint16_t calculate_fuel_purchase(Commander *cmdr, uint16_t fuelAmount)
 {
-	if(fuelAmount+Fuel>MaxFuel)
-		fuelAmount=MaxFuel-Fuel;
+	if(fuelAmount+cmdr->fuel>MaxFuel)
+		fuelAmount=MaxFuel-cmdr->fuel;
 
 	if(FuelCost>0)
 	{
-		if((int)fuelAmount*FuelCost > Cash) 
-			fuelAmount=(uint16_t)(Cash/FuelCost);
+		if(money_times(FuelCost, fuelAmount) > cmdr->cash) 
+			fuelAmount=(uint16_t)(cmdr->cash > 0 ? cmdr->cash/FuelCost : 0);
 	}
 
-	Fuel+=fuelAmount;
-	Cash-=FuelCost*fuelAmount;
+	cmdr->fuel+=fuelAmount;
+	money_add(&cmdr->cash, -money_times(FuelCost, fuelAmount));
 
 	return fuelAmount;
 }
@@ -865,17 +4594,21 @@ uint16_t calculate_fuel_purchase(uint16_t fuelAmount)
 /* Buy ammount S of fuel */
 bool do_fuel(char *commandArguments)
 {
-	uint16_t f=calculate_fuel_purchase((uint16_t)floor(10*atof(commandArguments)));
+	int64_t wanted = 0;
+	char fuel[MONEY_WIDTH];
+	parse_tenths(commandArguments, &wanted);
+	uint16_t f=calculate_fuel_purchase(&Player,(uint16_t)(wanted < 0 ? 0 : wanted > UINT16_MAX ? UINT16_MAX : wanted));
 	if(f==0) { printf("\nCan't buy any fuel");}
-	printf("\nBuying %.1fLY fuel",(float)f/10);
+	printf("\nBuying %sLY fuel",format_tenths(f,fuel));
 	return true;
 }
 
 /* Cheat alter cash by S */
 bool do_cash(char *commandArguments)
 {
-	int a=(int)(10*atof(commandArguments));
-	Cash+=(long)a;
+	Money a = 0;
+	parse_tenths(commandArguments, &a);
+	money_add(&Player.cash, a);
 
 	if(a != 0) 
 		return true;
@@ -888,13 +4621,14 @@ bool do_cash(char *commandArguments)
 /* Show stock market */
 bool do_market_display(char *commandArguments)
 {
+	char fuel[MONEY_WIDTH];
 	(void)commandArguments; // Mark 's' as unused as the condition was always true
 	// if((uint16_t)atoi(s) >= 0) // This condition is always true
 	// {
-		display_market_info(LocalMarket);
+		display_market_info(Player.localMarket);
 
-		printf("\nFuel :%.1f",(float)Fuel/10);
-		printf("      Holdspace :%it",HoldSpace);
+		printf("\nFuel :%s",format_tenths(Player.fuel,fuel));
+		printf("      Holdspace :%it",Player.holdSpace);
 		return true;
 	// }
 	// else
@@ -922,6 +4656,7 @@ bool parse_and_execute_command(char *commandString)
 bool do_quit(char *commandArguments)
 {
 	(void)(&commandArguments);
+	digest_finish();
 	exit(ExitStatus);
 	return ExitStatus == EXIT_SUCCESS ? true : false;
 }
@@ -944,13 +4679,179 @@ bool do_help(char *commandArguments)
 	printf("\nQuit or ^C       (exit)");
 	printf("\nHelp             (display this text)");
 	printf("\nRand             (toggle RNG)");
+	printf("\nFind query       (eg. find e0 g7 d20, find g0 t10+)");
+	printf("\nRoute planetname (fewest jumps and least fuel there)");
+	printf("\nSim strategy n j (n commanders, j jumps: random, food, greedy)");
+	printf("\nNpc n t          (n traders for t ticks in shared markets)");
+	printf("\nTick n           (advance the economy n ticks, * for all galaxies)");
+	printf("\nArbitrage n      (best cargo to each system in range, top n overall)");
+	printf("\nPlan n           (most profitable n-jump trading itinerary from here)");
+	printf("\nFill planetname  (buy the most profitable cargo for there at once)");
 	printf("\n\nAbbreviations allowed eg. b fo 5 = Buy Food 5, m= Mkt");
 	return true;
 }
 
-int main()
+int main(int argc, char *argv[])
 {
-	char getcommand[MAX_LEN];
+	char getcommand[MAX_LEN], typed[MAX_LEN], cash[MONEY_WIDTH];
+	bool emitUniverse = false, verifyUniverse = false;
+	const char *scanQuery = NULL, *spectatePath = NULL;
+	struct SeedType scanStart;
+	uint64_t scanCount = 0;
+
+	for(int arg = 1; arg < argc; arg++)
+	{
+		if(strcmp(argv[arg], "--emit-universe") == 0)
+			emitUniverse = true;
+		else if(strcmp(argv[arg], "--verify-universe") == 0)
+			verifyUniverse = true;
+		else if(strcmp(argv[arg], "--seed") == 0 && arg + 1 < argc)
+		{
+			if(!parse_seed(argv[++arg], &BaseSeed))
+			{
+				fprintf(stderr, "Bad seed %s (expected w0:w1:w2 in hex)\n", argv[arg]);
+				return EXIT_FAILURE;
+			}
+			CustomSeed = true;
+		}
+		else if(strcmp(argv[arg], "--galaxies") == 0 && arg + 1 < argc)
+		{
+			long n = strtol(argv[++arg], NULL, 0);
+			if(n < 1 || n > MAX_GALAXIES)
+			{
+				fprintf(stderr, "Bad galaxy count %s (1 to %i)\n", argv[arg], MAX_GALAXIES);
+				return EXIT_FAILURE;
+			}
+			GalaxyCount = (uint16_t)n;
+		}
+		else if(strcmp(argv[arg], "--galaxy-size") == 0 && arg + 1 < argc)
+		{
+			long n = strtol(argv[++arg], NULL, 0);
+			if(n <= NUM_FOR_LAVE || n > MAX_GAL_SIZE)
+			{
+				fprintf(stderr, "Bad galaxy size %s (%i to %i)\n", argv[arg], NUM_FOR_LAVE + 1, MAX_GAL_SIZE);
+				return EXIT_FAILURE;
+			}
+			GalaxySize = (PlanetNum)n;
+		}
+		else if((strcmp(argv[arg], "--reversion") == 0 || strcmp(argv[arg], "--volatility") == 0) && arg + 1 < argc)
+		{
+			bool reversion = strcmp(argv[arg], "--reversion") == 0;
+			long n = strtol(argv[++arg], NULL, 0);
+			if(n < 0 || n > 256)
+			{
+				fprintf(stderr, "Bad %s %s (0 to 256)\n", reversion ? "reversion" : "volatility", argv[arg]);
+				return EXIT_FAILURE;
+			}
+			*(reversion ? &EconomyReversion : &EconomyVolatility) = (int32_t)n;
+		}
+		else if(strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc)
+		{
+			long n = strtol(argv[++arg], NULL, 0);
+			if(n < 1 || n > MAX_WORKERS)
+			{
+				fprintf(stderr, "Bad thread count %s (1 to %i)\n", argv[arg], MAX_WORKERS);
+				return EXIT_FAILURE;
+			}
+			WorkerCount = (uint32_t)n;
+		}
+		else if(strcmp(argv[arg], "--digest") == 0 && arg + 1 < argc)
+		{
+			if((DigestOut = fopen(argv[++arg], "w")) == NULL)
+			{
+				fprintf(stderr, "Cannot write digests to %s\n", argv[arg]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if(strcmp(argv[arg], "--verify") == 0 && arg + 1 < argc)
+		{
+			if(!load_digest_reference(argv[++arg]))
+			{
+				fprintf(stderr, "Cannot read digests from %s\n", argv[arg]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if(strcmp(argv[arg], "--hibernate-after") == 0 && arg + 1 < argc)
+		{
+			long n = strtol(argv[++arg], NULL, 0);
+			if(n < 0 || n > 86400)
+			{
+				fprintf(stderr, "Bad idle time %s (0 to 86400 seconds)\n", argv[arg]);
+				return EXIT_FAILURE;
+			}
+			HibernateAfter = (uint32_t)n;
+		}
+		else if(strcmp(argv[arg], "--feed") == 0 && arg + 1 < argc)
+		{
+			if((Feed = map_feed(argv[++arg], true)) == NULL)
+			{
+				fprintf(stderr, "Cannot create feed %s\n", argv[arg]);
+				return EXIT_FAILURE;
+			}
+			atexit(feed_close);
+		}
+		else if(strcmp(argv[arg], "--spectate") == 0 && arg + 1 < argc)
+			spectatePath = argv[++arg];
+		else if(strcmp(argv[arg], "--fresh-markets") == 0)
+			PersistentMarkets = false;
+		else if(strcmp(argv[arg], "--scan") == 0 && arg + 3 < argc)
+		{
+			char *end;
+			scanQuery = argv[++arg];
+			if(!parse_seed(argv[++arg], &scanStart))
+			{
+				fprintf(stderr, "Bad seed %s (expected w0:w1:w2 in hex)\n", argv[arg]);
+				return EXIT_FAILURE;
+			}
+			scanCount = strtoull(argv[++arg], &end, 0);
+			if(*end != 0 || scanCount < 1 || scanCount > 1ull << 48)
+			{
+				fprintf(stderr, "Bad seed count %s (1 to 2^48)\n", argv[arg]);
+				return EXIT_FAILURE;
+			}
+		}
+		else
+		{
+			fprintf(stderr, "Unknown option %s\n", argv[arg]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if(scanQuery != NULL)
+	{
+		ScanQuery query;
+		if(!parse_scan_query(scanQuery, &query))
+		{
+			fprintf(stderr, "Bad scan %s (name=INDEX:NAME, anarchy-tl15, dense=N; comma separated)\n", scanQuery);
+			return EXIT_FAILURE;
+		}
+		scan_seeds(&query, scanStart, scanCount);
+		return EXIT_SUCCESS;
+	}
+
+	if(spectatePath != NULL)
+	{
+		load_universe();
+		if(spectate(spectatePath)) return EXIT_SUCCESS;
+		fprintf(stderr, "Cannot read feed %s\n", spectatePath);
+		return EXIT_FAILURE;
+	}
+
+	if(emitUniverse)
+	{
+		emit_universe();
+		return EXIT_SUCCESS;
+	}
+
+	if(verifyUniverse)
+	{
+		load_universe();
+		bool ok = verify_universe();
+		printf("Universe tables %s (%s)\n", ok ? "verified" : "differ",
+		       GeneratedUniverse != NULL ? "generated" : "embedded or mapped");
+		return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
 	NativeRand=1;
 	printf("\nWelcome to Text Elite 1.5.\n");
 
@@ -959,13 +4860,15 @@ int main()
 
 	my_srand(12345);/* Ensure repeatability */
 
-	GalaxyNum=1;
-	build_galaxy_data(GalaxyNum);
+	Player.galaxyNum=1;
+	load_universe();
+	build_galaxy_data(Player.galaxyNum);
 
-	CurrentPlanet=NUM_FOR_LAVE;                        /* Don't use jump */
-	LocalMarket = generate_market(0x00,Galaxy[NUM_FOR_LAVE]);/* Since want seed=0 */
+	Player.currentPlanet=NUM_FOR_LAVE;                        /* Don't use jump */
+	Player.localMarket = generate_market(0x00,sys_economy(Galaxy->attrs[NUM_FOR_LAVE]));/* Since want seed=0 */
 
-	Fuel=MaxFuel;
+	Player.fuel=MaxFuel;
+	neighbour_request(Player.galaxyNum, Player.currentPlanet);
 
 #define PARSER(S) { char buf[0x10]; strcpy(buf,S); parse_and_execute_command(buf); }   
 
@@ -977,14 +4880,18 @@ int main()
 
 	for(;;)
 	{
-		printf("\n\nCash :%.1f>",((float)Cash)/10);
-		if (!fgets(getcommand, sizeof(getcommand) - 1, stdin))
+		printf("\n\nCash :%s>",format_tenths(Player.cash,cash));
+		if (!read_command(getcommand, sizeof(getcommand) - 1))
 			break;
 		getcommand[sizeof(getcommand) - 1] = '\0';
+		strcpy(typed, getcommand);  /* The parser cuts up its copy */
 		parse_and_execute_command(getcommand);
+		if(DigestOut != NULL || DigestReference != NULL) digest_command(typed);
+		if(Feed != NULL) feed_command();
 	}
 
 	printf("\n");
+	digest_finish();
 
 	exit(ExitStatus);
 }
@@ -1044,25 +4951,38 @@ static struct DescChoice descList[] = // Renamed from desc_list
  * B1 = <planet name>ian
  * B2 = <random name>
  */
-int gen_rnd_number (void)
+int gen_rnd_number (struct FastSeedType *rndSeed)
 {
 	int a,x;
-	x = (RndSeed.a * 2) & 0xFF;
-	a = x + RndSeed.c;
-	if (RndSeed.a > 127)	a++;
-	RndSeed.a = a & 0xFF;
-	RndSeed.c = x;
+	x = (rndSeed->a * 2) & 0xFF;
+	a = x + rndSeed->c;
+	if (rndSeed->a > 127)	a++;
+	rndSeed->a = a & 0xFF;
+	rndSeed->c = x;
 
 	a = a / 256;	/* a = any carry left from above */
-	x = RndSeed.b;
-	a = (a + x + RndSeed.d) & 0xFF;
-	RndSeed.b = a;
-	RndSeed.d = x;
+	x = rndSeed->b;
+	a = (a + x + rndSeed->d) & 0xFF;
+	rndSeed->b = a;
+	rndSeed->d = x;
 	return a;
 }
 
 
-void goat_soup(const char *sourceString, struct PlanSys *planetSystem)
+/* Append a character, dropping any that would overflow the description */
+void describe_char(Description *out, int c)
+{
+	if(out->length + 1 < DESCRIPTION_WIDTH) out->text[out->length++] = (char)c;
+	out->text[out->length] = '\0';
+}
+
+void describe_text(Description *out, const char *text)
+{
+	while(*text) describe_char(out, *text++);
+}
+
+/* Expand sourceString into out, drawing choices from rndSeed */
+void goat_soup(const char *sourceString, const struct PlanSys *planetSystem, struct FastSeedType *rndSeed, Description *out)
 {
 	for(;;)
 	{	int c=*(sourceString++);
@@ -1072,27 +4992,27 @@ void goat_soup(const char *sourceString, struct PlanSys *planetSystem)
 		   interpreted as negative. */
 		c &= 0xff;
 		if(c=='\0')	break;
-		if(c < 0x80) printf("%c",c);
+		if(c < 0x80) describe_char(out,c);
 		else
 		{	if (c <= 0xA4)
-			{	int rnd = gen_rnd_number();
-				goat_soup(descList[c-0x81].options[(rnd >= 0x33)+(rnd >= 0x66)+(rnd >= 0x99)+(rnd >= 0xCC)],planetSystem);
+			{	int rnd = gen_rnd_number(rndSeed);
+				goat_soup(descList[c-0x81].options[(rnd >= 0x33)+(rnd >= 0x66)+(rnd >= 0x99)+(rnd >= 0xCC)],planetSystem,rndSeed,out);
 			}
 			else switch(c)
 			{ case 0xB0: /* planet name */
 				{ int i=1;
-					printf("%c",planetSystem->name[0]);
-					while(planetSystem->name[i]!='\0') printf("%c",tolower(planetSystem->name[i++]));
+					describe_char(out,planetSystem->name[0]);
+					while(planetSystem->name[i]!='\0') describe_char(out,tolower(planetSystem->name[i++]));
 				}	break;
 				case 0xB1: /* <planet name>ian */
 				{ int i=1;
-					printf("%c",planetSystem->name[0]);
+					describe_char(out,planetSystem->name[0]);
 					while(planetSystem->name[i]!='\0')
 					{	if((planetSystem->name[i+1]!='\0') || ((planetSystem->name[i]!='E')	&& (planetSystem->name[i]!='I')))
-						printf("%c",tolower(planetSystem->name[i]));
+						describe_char(out,tolower(planetSystem->name[i]));
 						i++;
 					}
-					printf("ian");
+					describe_text(out,"ian");
 				}	break;
 				case 0xB2: /* random name */
 
@@ -1102,20 +5022,20 @@ void goat_soup(const char *sourceString, struct PlanSys *planetSystem)
 #if 1 // 1.5
 				{
 					int i;
-					int len = gen_rnd_number() & 3;
+					int len = gen_rnd_number(rndSeed) & 3;
 					for (i = 0; i <= len; i++)
 					{
-						int x = gen_rnd_number() & 0x3e;
+						int x = gen_rnd_number(rndSeed) & 0x3e;
 						if (i == 0)
 						{
-							printf("%c",pairs0[x]);
+							describe_char(out,pairs0[x]);
 						}
 						else
 						{
-							printf("%c",tolower(pairs0[x]));
+							describe_char(out,tolower(pairs0[x]));
 						}
 
-						printf("%c",tolower(pairs0[x+1]));
+						describe_char(out,tolower(pairs0[x+1]));
 
 					} // endfor
 				}
@@ -1124,17 +5044,21 @@ void goat_soup(const char *sourceString, struct PlanSys *planetSystem)
 
 
 				{	int i;
-					int len = gen_rnd_number() & 3;
+					int len = gen_rnd_number(rndSeed) & 3;
 					for(i=0;i<=len;i++)
-					{	int x = gen_rnd_number() & 0x3e;
-						if(pairs0[x]!='.') printf("%c",pairs0[x]);
-						if(i && (pairs0[x+1]!='.')) printf("%c",pairs0[x+1]);
+					{	int x = gen_rnd_number(rndSeed) & 0x3e;
+						if(pairs0[x]!='.') describe_char(out,pairs0[x]);
+						if(i && (pairs0[x+1]!='.')) describe_char(out,pairs0[x+1]);
 					}
 				}
 #endif				
 
 				break;
-				default: printf("<bad char in data [%X]>",c); return;
+				default:
+				{	char bad[32];
+					snprintf(bad,sizeof(bad),"<bad char in data [%X]>",c);
+					describe_text(out,bad);
+				}	return;
 			}	/* endswitch */
 		}	/* endelse */
 	}	/* endwhile */